@@ -22,7 +22,8 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
     var memrange = resources.memoryRange;
     var allocator = resources.allocator;
 
-    var acpiDevices = acpi.getPciDevices();
+    // Snapshot of all ACPI device objects
+    var acpiDevices = acpi.getNamespace();
 
     var address_port = io.port(0xCF8);
     var data_port = io.port(0xCFC);
@@ -219,41 +220,38 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
     })(address_port, data_port);
 
     /**
-     * Find ACPI PCI device bus, slot and function
+     * Find ACPI PCI device bus, slot and function, device is
+     * a node of ACPI namespace snapshot
      */
     function locateAcpiDevice(dev) {
-        if (!dev.isDevice()) {
+        if (null === dev.address) {
             return null;
         }
 
-        var addr = dev.address();
+        var addr = dev.address;
         var slotId = ((addr >>> 16) & 0xffff) >>> 0;
         var funcId = (addr & 0xffff) >>> 0;
 
-        if (dev.isRootBridge()) {
-            var busId = dev.getRootBridgeBusNumber();
-
+        if (dev.isRootBridge) {
             return {
-                bus: busId,
+                bus: dev.bus,
                 slot: slotId,
                 func: funcId,
             };
         }
 
-        var parentDev = dev.parent();
-        if (null === parentDev) {
+        if (null === dev.parent) {
             return null;
         }
 
-        if (!parentDev.isDevice()) {
+        var parentDev = acpiDevices[dev.parent];
+        if (null === parentDev.address) {
             return null;
         }
 
-        if (parentDev.isRootBridge()) {
-            var busId = parentDev.getRootBridgeBusNumber();
-
+        if (parentDev.isRootBridge) {
             return {
-                bus: busId,
+                bus: parentDev.bus,
                 slot: slotId,
                 func: funcId,
             };
@@ -636,16 +634,10 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
         pciManager.addDevice(address, pciAccessor);
     });
 
-    // Collect bus ACPI device handles with their bus numbers
-    var acpiDevicesBuses = [];
+    // Attach ACPI device nodes to PCI devices
     acpiDevices.forEach(function(acpiDevice) {
         var address = locateAcpiDevice(acpiDevice);
 
-        if (acpiDevice.isRootBridge()) {
-            var busId = acpiDevice.getRootBridgeBusNumber();
-            acpiDevicesBuses[busId] = acpiDevice;
-        }
-
         // Check if unable to locate ACPI device on PCI bus
         if (null === address) {
             return;
@@ -659,26 +651,21 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
         }
 
         dev.attachAcpiDevice(acpiDevice);
-
-        if (dev.isBridge()) {
-            var busId = dev.getSecondaryBus();
-            acpiDevicesBuses[busId] = acpiDevice;
-        }
     });
 
-    // Extract IRQ routing information
+    // Extract IRQ routing information, kernel evaluates _PRT
+    // of all PCI roots and bridges once on init
     var busRouting = [];
-    acpiDevicesBuses.forEach(function(acpiDevice, bus) {
-        if ('undefined' === typeof acpiDevice) {
+    acpi.getPciIrqRoutes().forEach(function(route) {
+        if (0 !== route.segment) {
             return;
         }
 
-        var routes = acpiDevice.getIrqRoutingTable();
-        if (!Array.isArray(routes)) {
-            return;
+        if ('undefined' === typeof busRouting[route.bus]) {
+            busRouting[route.bus] = [];
         }
 
-        busRouting[bus] = routes;
+        busRouting[route.bus].push(route);
     });
 
     // Set IRQs
@@ -725,6 +712,10 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
         }
     });
 
+    // Interfaces registered by started device drivers
+    var driverInterfaces = [];
+    var driverListeners = [];
+
     // Start drivers
     pciManager.each(function(pciDevice) {
         var vendorId = pciDevice.vendorId();
@@ -767,6 +758,17 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
                 irq: irqObject,
             },
             allocator: allocator,
+            // Driver passes its interface object when device is ready
+            register: function(driverInterface) {
+                var entry = {
+                    device: pciDevice,
+                    name: driverData.name,
+                    driver: driverInterface,
+                };
+
+                driverInterfaces.push(entry);
+                driverListeners.forEach(function(fn) { fn(entry); });
+            },
         }
 
         procManager.create(rt.initrdText("/driver/" + driverData.driver),
@@ -796,5 +798,15 @@ define('pci', ['pciDrivers', 'resources'], function(pciDrivers, resources) {
         rt.log(info);
     });
 
-    return {};
+    return {
+        driverInterfaces: function() { return driverInterfaces; },
+        /**
+         * Call function for every driver interface, including
+         * interfaces registered before the call
+         */
+        onDriver: function(fn) {
+            driverInterfaces.forEach(fn);
+            driverListeners.push(fn);
+        },
+    };
 });
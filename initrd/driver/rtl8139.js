@@ -15,9 +15,6 @@
 (function RTL8139Driver(args) {
     "use strict";
 
-    //TODO: remove this
-    return;
-
     var utils = rt.initrdRequire("/utils.js");
     var mmio = args.pci.bars[1];
     var iobuf = mmio.resource.buffer();
@@ -49,6 +46,7 @@
         ];
         var txCount = 4;
         var txCurrent = 0;
+        var txDirty = 0;
         var txDirtyCount = 0;
 
         var buffer = allocated.buffer;
@@ -56,13 +54,20 @@
         var rx = {
             address: allocated.address + rxOffset,
             length: rxSize,
-            copy: function(offset, size) {
-                return buffer.slice(rxOffset + offset, rxOffset + offset + size);
-            },
             b: new Uint8Array(buffer, rxOffset, rxSize + rxExtraWrap),
             w: new Uint16Array(buffer, rxOffset, (rxSize + rxExtraWrap) >>> 1),
         };
 
+        // Received packets are copied into pooled ArrayBuffers and
+        // moved to consumer, which can be in another process. Consumer
+        // moves buffer back using recycle when done with packet
+        var poolSlotSize = 2 * sizeMult.KiB;
+        var poolCount = 64;
+        var poolFree = [];
+        for (var i = 0; i < poolCount; ++i) {
+            poolFree.push(new ArrayBuffer(poolSlotSize));
+        }
+
         var tx = txOffsets.map(function(offset, index) {
             return {
                 index: index,
@@ -74,6 +79,25 @@
 
         return {
             rx: function() { return rx; },
+            takePacket: function() {
+                if (0 === poolFree.length) {
+                    return null;
+                }
+
+                return poolFree.pop();
+            },
+            // Buffers of other size, transferred or duplicate ones
+            // are ignored
+            recyclePacket: function(buffer) {
+                if (!(buffer instanceof ArrayBuffer) ||
+                    poolSlotSize !== buffer.byteLength ||
+                    poolFree.length >= poolCount ||
+                    -1 !== poolFree.indexOf(buffer)) {
+                    return;
+                }
+
+                poolFree.push(buffer);
+            },
             // tx: function(index) { return tx[index]; },
             takeTx: function() {
                 if (txDirtyCount >= txCount) {
@@ -89,6 +113,24 @@
 
                 return txc;
             },
+            // Oldest descriptor owned by chip, null if all are free
+            dirtyTx: function() {
+                if (0 === txDirtyCount) {
+                    return null;
+                }
+
+                return tx[txDirty];
+            },
+            releaseTx: function() {
+                if (0 === txDirtyCount) {
+                    return;
+                }
+
+                --txDirtyCount;
+                if (++txDirty >= txCount) {
+                    txDirty = 0;
+                }
+            },
         };
     })();
 
@@ -444,46 +486,216 @@
     var curRx = 0;
     var maxEthernetPacketSize = 1536;
 
-    function ab2str(buf) {
-        var s = '';
-        var v = new Uint8Array(buf);
-        for (var i = 0; i < v.length; ++i) {
-            var t = v[i].toString(16);
-            if (1 === t.length) {
-                t = '0' + t;
-            }
-            s += t + ' ';
-        }
+    var stats = {
+        rxPackets: 0,
+        rxDropped: 0,
+        rxErrors: 0,
+    };
 
-        return s;
+    /**
+     * Called for every received packet with pooled ArrayBuffer and
+     * packet length. Buffer is moved to receiver, which should give
+     * it back using recycle when packet is not used anymore. Packets
+     * are dropped until consumer sets receiver using onReceive
+     */
+    var receiver = null;
+
+    function deliver(buffer, length) {
+        try {
+            receiver(buffer, length);
+        } catch (err) {
+            // Buffer stays here if it wasn't moved
+            buffers.recyclePacket(buffer);
+            ++stats.rxDropped;
+            rt.log('rtl8139: receiver failed', err);
+        }
     }
 
     function recv() {
-        while (0 == (r.read(r.CR) & r.CR.flag.RX_EMPTY)) {
-            var rx = buffers.rx();
+        var rx = buffers.rx();
 
+        while (0 == (r.read(r.CR) & r.CR.flag.RX_EMPTY)) {
             var offset = curRx % rx.length;
 
-
             var frameHeader = rx.w[offset >>> 1];
             var frameSize = rx.w[(offset + 2) >>> 1];
 
             // CRC size 4 bytes
             var packetSize = frameSize - 4;
+            var buffer = null;
 
             if (packetSize > maxEthernetPacketSize || packetSize < 8) {
-                rt.log('invalid packet size');
+                ++stats.rxErrors;
+            } else {
+                buffer = null === receiver ? null : buffers.takePacket();
+                if (null === buffer) {
+                    // No consumer or it holds all buffers, drop packet
+                    ++stats.rxDropped;
+                } else {
+                    // Ring buffer is reused by chip, packet gets copied
+                    // into pooled buffer, only view object is allocated
+                    new Uint8Array(buffer, 0, packetSize)
+                        .set(rx.b.subarray(offset + 4, offset + 4 + packetSize));
+                    ++stats.rxPackets;
+                }
             }
 
-            var packet = rx.copy(offset + 4, packetSize);
-            // rt.log('recv packet size', packetSize, 'data', ab2str(packet));
-            rt.log('recv packet size', packetSize);
-
+            // Give ring space back to chip before consumer runs,
+            // so failing receiver can't stall the ring
             curRx = (curRx + frameSize + 4 + 3) & 0xfffffffc;
-            r.write(r.CAPR, curRx - 16);
+            r.write(r.CAPR, (curRx - 16) & 0xffff);
+
+            if (null !== buffer) {
+                deliver(buffer, packetSize);
+            }
+        }
+    }
+
+    /**
+     * Transmit queue, keeps all chip descriptors busy while there are
+     * packets waiting. Descriptors are recycled on TOK interrupt
+     */
+    var txQueueMax = 64;
+    var txQueue = [];
+    var txDrainListeners = [];
+    var minEthernetFrameSize = 60;
+
+    var txStatusFlag = {
+        OWN: (1 << 13),
+        TUN: (1 << 14),
+        TOK: (1 << 15),
+        TABT: (1 << 30),
+    };
+
+    stats.txPackets = 0;
+    stats.txErrors = 0;
+
+    function reclaimTx() {
+        var tx;
+        while (null !== (tx = buffers.dirtyTx())) {
+            var status = r.read(r.TX_STATUS[tx.index]);
+            if (0 === (status & (txStatusFlag.TOK | txStatusFlag.TUN | txStatusFlag.TABT))) {
+                break;
+            }
+
+            if (status & txStatusFlag.TOK) {
+                ++stats.txPackets;
+            } else {
+                ++stats.txErrors;
+            }
+
+            buffers.releaseTx();
+        }
+    }
+
+    function kickTx() {
+        while (txQueue.length > 0) {
+            var tx = buffers.takeTx();
+            if (null === tx) {
+                break;
+            }
+
+            var packet = txQueue.shift();
+            var len = packet.length;
+
+            // Copy packet into Tx buffer, pad short frames
+            tx.b.set(packet);
+            if (len < minEthernetFrameSize) {
+                for (var i = len; i < minEthernetFrameSize; ++i) {
+                    tx.b[i] = 0;
+                }
+                len = minEthernetFrameSize;
+            }
+
+            r.write(r.TX_START[tx.index], tx.address >>> 0);
+            r.write(r.TX_STATUS[tx.index], (len & 0x1fff) >>> 0);
         }
+
+        if (0 === txQueue.length && txDrainListeners.length > 0) {
+            var listeners = txDrainListeners;
+            txDrainListeners = [];
+            listeners.forEach(callDrainListener);
+        }
+    }
+
+    /**
+     * Listeners can be functions of another process, call them
+     * outside of IRQ handler so failing call can't break it
+     */
+    function callDrainListener(fn) {
+        rt.timeout(function() {
+            try {
+                fn();
+            } catch (err) {
+                rt.log('rtl8139: drain listener failed', err);
+            }
+        }, 0);
     }
 
+    /**
+     * Queue array of ArrayBuffer packets for transmission. Packets
+     * are moved to driver when called from another process, so
+     * packets that didn't fit into queue are returned as array and
+     * should be resent after onDrain callback. Throws if any packet
+     * is not an ArrayBuffer or larger than maximum frame size,
+     * nothing is queued then
+     */
+    function send(packets) {
+        var views = packets.map(function(packet) {
+            if (!(packet instanceof ArrayBuffer)) {
+                throw new TypeError('packet is not an ArrayBuffer');
+            }
+
+            if (packet.byteLength > maxEthernetPacketSize) {
+                throw new RangeError('packet is larger than ' + maxEthernetPacketSize + ' bytes');
+            }
+
+            return new Uint8Array(packet);
+        });
+
+        var accepted = 0;
+        while (accepted < views.length && txQueue.length < txQueueMax) {
+            txQueue.push(views[accepted++]);
+        }
+
+        reclaimTx();
+        kickTx();
+        return packets.slice(accepted);
+    }
+
+    /**
+     * Call function once transmit queue is empty. Function is
+     * always called asynchronously
+     */
+    function onDrain(fn) {
+        if (0 === txQueue.length) {
+            callDrainListener(fn);
+            return;
+        }
+
+        txDrainListeners.push(fn);
+    }
+
+    /**
+     * Interface exported to network stack
+     */
+    var driverInterface = {
+        send: send,
+        onDrain: onDrain,
+        /**
+         * Set function called for every received packet, see receiver
+         */
+        onReceive: function(fn) {
+            receiver = fn;
+        },
+        /**
+         * Return packet buffer received by receiver to the pool
+         */
+        recycle: function(buffer) {
+            buffers.recyclePacket(buffer);
+        },
+    };
+
     function Handler() {
         var status = r.read(r.ISR);
 
@@ -505,8 +717,9 @@
             // rt.log('recv');
         }
 
-        if (status & r.ISR.flag.SEND_OK) {
-            rt.log('sent');
+        if (status & (r.ISR.flag.SEND_OK | r.ISR.flag.SEND_ERROR)) {
+            reclaimTx();
+            kickTx();
         }
     }
 
@@ -517,23 +730,13 @@
         }, 100);
     }
 
-    function transmit(buffer) {
-        rt.log('transmit');
-        var len = buffer.byteLength;
-        
-        var tx = buffers.takeTx();
-
-        // Copy packet buffer into Tx buffer
-        tx.b.set(buffer);
-        r.write(r.TX_START[tx.index], tx.address >>> 0);
-        r.write(r.TX_STATUS[tx.index], (len & 0x1fff) >>> 0);
+    if (null !== irq) {
+        irq.on(function() {
+            irqCounter.inc();
+            Handler();
+        });
     }
 
-    // irq.on(function() {
-    //     irqCounter.inc();
-    //     Handler();
-    // });
-
     startup()
         .chain(powerUp)
         .chain(reset)
@@ -541,11 +744,13 @@
         .chain(configure)
         .chain(enableInterrupt)
         .chain(poll)
-        .chain(function() {
-            var b = new ArrayBuffer(64);
-            transmit(b);
-        })
         .then(function() {
+            // Remote functions are callable objects, typeof
+            // reports them as 'object'
+            if (args.register) {
+                args.register(driverInterface);
+            }
+
             rt.log('chip ready.');
         }, function(error) {
             rt.log('chip failed.', error.stack);
@@ -22,6 +22,7 @@ function(kernelLoader) {
     kernelLoader.load('/system/driver/ps2kbd.js');
     kernelLoader.load('/driver/pci.js');
     kernelLoader.load('/driver/pci-drivers.js');
+    kernelLoader.load('/system/net-devices.js');
 
     // Start PCI bus driver
     // procManager.create(rt.initrdText("/driver/pci.js"), {
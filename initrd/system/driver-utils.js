@@ -27,5 +27,8 @@ function(resources) {
         ioPort: function(number) {
             return resources.ioRange.port(number >>> 0);
         },
+        keyboard: function() {
+            return resources.keyboard;
+        },
     };
 });
@@ -73,7 +73,7 @@ function(keyboard, driverUtils) {
         scrllock: false,
     };
 
-    var irq = driverUtils.irq(1);
+    var controller = driverUtils.keyboard();
     var port = driverUtils.ioPort(0x60);
 
     function init() {
@@ -151,28 +151,35 @@ function(keyboard, driverUtils) {
 
     var escaped = false;
 
-    irq.on(function() {
-        var code = port.read8();
-
+    function scancode(code) {
         if (0xe0 === code) {
             escaped = true;
+            return;
+        }
+
+        if (code & 0x80) {
+            if (escaped) {
+                keyEvent(code, false);
+            } else {
+                keyEvent(code & 0x7f, false);
+            }
         } else {
-            if (code & 0x80) {
-                if (escaped) {
-                    keyEvent(code, false);
-                } else {
-                    keyEvent(code & 0x7f, false);
-                }
+            if (escaped) {
+                keyEvent(code | 0x80, true);
             } else {
-                if (escaped) {
-                    keyEvent(code | 0x80, true);
-                } else {
-                    keyEvent(code, true);
-                }
+                keyEvent(code, true);
             }
         }
 
         escaped = false;
+    }
+
+    // Kernel drains controller in IRQ handler and delivers
+    // all scancodes received since previous call
+    controller.onScancodes(function(codes) {
+        for (var i = 0; i < codes.length; ++i) {
+            scancode(codes[i]);
+        }
     });
 
     init();
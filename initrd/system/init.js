@@ -140,7 +140,21 @@ var __init = (function (__native) {
         if (!isFunction(func)) {
             throw new TypeError("tick: Argument 0 is not a Function.");
         }
-        __native.tick(func);
+        __native.yield(func);
+    });
+
+    /**
+     * Schedules function to run after other runnable threads had
+     * a chance to run. No timer is involved, use this to split
+     * long computations into chunks
+     * @param {Function} func Function to call
+     * @return {Undefined}
+     */
+    install(rt, "yield", function __yield(func) {
+        if (!isFunction(func)) {
+            throw new TypeError("yield: Argument 0 is not a Function.");
+        }
+        __native.yield(func);
     });
 
     /**
@@ -196,42 +210,6 @@ var __init = (function (__native) {
         resourcesLoaded = true;
         return obj;
     });
-
-    /**
-     * Helper function to support IPC function calls
-     */
-    var callWrapper = function __callWrapper(fn, threadPtr, argsArray, promiseid) {
-        if (null === fn) {
-            // Invalid function call
-            __native.callResult(false, threadPtr, promiseid, null);
-            return;
-        }
-
-        var ret = fn.apply(this, argsArray);
-
-        if (ret instanceof Promise) {
-            if (!ret.then) return;
-
-            ret.then(function(result) {
-                __native.callResult(true, threadPtr, promiseid, result);
-            }, function(result) {
-                __native.callResult(false, threadPtr, promiseid, result);
-            }).catch(function(err) {
-                // TODO: rethrow this error outside of promise handler
-                rt.log(err.stack);
-
-                __native.callResult(false, threadPtr, promiseid, null);
-            });
-
-            return;
-        }
-
-        __native.callResult(true, threadPtr, promiseid, ret);
-    };
-
-    __native.installInternals({
-        callWrapper: callWrapper,
-    });
 });
 
 // Keep this as last statement
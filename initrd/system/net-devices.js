@@ -0,0 +1,113 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+define('netDevices', ['pci'],
+function(pci) {
+    "use strict";
+
+    var devices = [];
+
+    /**
+     * Network device registered by PCI driver. Driver interface
+     * functions live in driver process, all calls are asynchronous
+     */
+    function NetDevice(name, driver) {
+        var self = this;
+        this.name = name;
+        this.driver = driver;
+        this.rxPackets = 0;
+        this.rxBytes = 0;
+        this.txPending = [];
+        this.txWaiting = false;
+
+        // Packet buffers are moved here, count them and give
+        // them back to driver pool
+        driver.onReceive(function(buffer, length) {
+            ++self.rxPackets;
+            self.rxBytes += length;
+            driver.recycle(buffer);
+        });
+    }
+
+    /**
+     * Queue ArrayBuffer packets for transmission. Packets are moved
+     * to driver, ones it can't queue yet come back and are resent
+     * once driver transmit queue drains
+     */
+    NetDevice.prototype.send = function(packets) {
+        this.txPending = this.txPending.concat(packets);
+        this.flush();
+    };
+
+    NetDevice.prototype.flush = function() {
+        var self = this;
+        if (self.txWaiting || 0 === self.txPending.length) {
+            return;
+        }
+
+        var packets = self.txPending;
+        self.txPending = [];
+        self.txWaiting = true;
+        self.driver.send(packets).then(function(rest) {
+            self.txPending = rest.concat(self.txPending);
+            if (0 === rest.length) {
+                self.txWaiting = false;
+                self.flush();
+                return;
+            }
+
+            self.driver.onDrain(function() {
+                self.txWaiting = false;
+                self.flush();
+            });
+        }, function(err) {
+            self.txWaiting = false;
+            rt.log('net device', self.name, 'send failed', err);
+        });
+    };
+
+    /**
+     * Broadcast frame with local experimental ethertype, used to
+     * check transmit path when device comes up
+     */
+    function testFrame() {
+        var buffer = new ArrayBuffer(64);
+        var b = new Uint8Array(buffer);
+        for (var i = 0; i < 6; ++i) {
+            b[i] = 0xff;
+        }
+
+        b[12] = 0x88;
+        b[13] = 0xb5;
+        return buffer;
+    }
+
+    pci.onDriver(function(entry) {
+        // Only network drivers accept receiver
+        var driver = entry.driver;
+        if (!driver.onReceive) {
+            return;
+        }
+
+        var device = new NetDevice(entry.name, driver);
+        devices.push(device);
+        device.send([testFrame()]);
+        rt.log('net device', entry.name);
+    });
+
+    return {
+        devices: function() { return devices; },
+    };
+});
@@ -117,6 +117,17 @@ var vfs = (function() {
         });
     }
 
+    /**
+     * Path lookup cache generation, incremented by every namespace
+     * change (mount, invalidate) to drop path caches of all roots
+     */
+    var pathCacheGeneration = 0;
+    var pathCacheMaxEntries = 1024;
+
+    function invalidatePathCache() {
+        ++pathCacheGeneration;
+    }
+
     function VFSNode(fs, inode, name) {
         this.fs = fs;
         this.inode = inode;
@@ -124,8 +135,25 @@ var vfs = (function() {
         this.lookupCache = null;
         this.listCached = false;
         this.mountedNode = null;
+        this.pathCache = null;
+        this.pathCacheGeneration = 0;
     }
 
+    /**
+     * Path-keyed cache of lookups from this node. Stores null for
+     * names that do not exist
+     */
+    VFSNode.prototype.getPathCache = function() {
+        if (null === this.pathCache ||
+            this.pathCacheGeneration !== pathCacheGeneration ||
+            this.pathCache.size >= pathCacheMaxEntries) {
+            this.pathCache = new Map();
+            this.pathCacheGeneration = pathCacheGeneration;
+        }
+
+        return this.pathCache;
+    };
+
     VFSNode.prototype.lookup = function(name, resolve) {
         var self = this;
 
@@ -211,6 +239,23 @@ var vfs = (function() {
         }
 
         self.mountedNode = vfsnode;
+        invalidatePathCache();
+    };
+
+    /**
+     * Drop cached children of this node after its filesystem
+     * has been changed. Path caches are invalidated as well
+     */
+    VFSNode.prototype.invalidate = function() {
+        var self = this;
+
+        if (null !== self.mountedNode) {
+            self = self.mountedNode;
+        }
+
+        self.lookupCache = null;
+        self.listCached = false;
+        invalidatePathCache();
     };
 
     function pathLookupNext(vfsnode, pathComponents, componentIndex, resolve) {
@@ -231,11 +276,38 @@ var vfs = (function() {
     }
 
     function pathLookup(vfsnodeRoot, pathComponents, resolve) {
+        var cache = vfsnodeRoot.getPathCache();
+        var key = pathComponents.join('/');
+
+        var cached = cache.get(key);
+        if ('undefined' !== typeof cached) {
+            resolve(cached);
+            return;
+        }
+
+        var generation = pathCacheGeneration;
         pathLookupNext(vfsnodeRoot, pathComponents, 0, function(vfsnode) {
+            // Don't cache result if namespace changed during lookup
+            if (generation === pathCacheGeneration) {
+                vfsnodeRoot.getPathCache().set(key, vfsnode);
+            }
+
             resolve(vfsnode);
         });
     }
 
+    /**
+     * Lookup multiple path strings at once. Returns promise resolved
+     * with array of nodes (null for paths that do not exist)
+     */
+    function pathLookupMany(vfsnodeRoot, paths) {
+        return Promise.all(paths.map(function(path) {
+            return new Promise(function(resolve, reject) {
+                pathLookup(vfsnodeRoot, parsePathString(path), resolve);
+            });
+        }));
+    }
+
     function init(fsRoot, fsInitrd) {
         var root = new VFSNode(fsRoot, fsRoot.getRootInode(), 'root');
 
@@ -253,6 +325,7 @@ var vfs = (function() {
         createFsInitrd: createFsInitrd,
         createFsRoot: createFsRoot,
         pathLookup: pathLookup,
+        pathLookupMany: pathLookupMany,
         init: init,
         parsePathString: parsePathString,
     };
@@ -15,6 +15,8 @@
 #include "acpi-manager.h"
 #include <stdio.h>
 #include <kernel/cpu.h>
+#include <kernel/platform.h>
+#include <string.h>
 
 namespace rt {
 
@@ -26,6 +28,8 @@ AcpiManager::AcpiManager() {
     if (!SetInterruptRoutingMode()) {
         return;
     }
+
+    UpdatePciIrqRoutes();
 }
 
 bool AcpiManager::SetInterruptRoutingMode() {
@@ -103,4 +107,462 @@ AcpiObjectsList AcpiManager::GetPciDevices() {
     return devlist;
 }
 
+class WalkResourcesIrqContext {
+public:
+    WalkResourcesIrqContext(AcpiPciIrqRoutingTable* routes, uint16_t segment,
+                            uint8_t bus, uint8_t device, uint8_t pin,
+                            uint8_t source_index)
+        :	_routes(routes),
+            _segment(segment),
+            _bus(bus),
+            _device(device),
+            _pin(pin),
+            _source_index(source_index) {
+        RT_ASSERT(_routes);
+    }
+    AcpiPciIrqRoutingTable* routes() const { return _routes; }
+    uint16_t segment() const { return _segment; }
+    uint8_t bus() const { return _bus; }
+    uint8_t device() const { return _device; }
+    uint8_t pin() const { return _pin; }
+    uint8_t source_index() const { return _source_index; }
+private:
+    AcpiPciIrqRoutingTable* _routes;
+    uint16_t _segment;
+    uint8_t _bus;
+    uint8_t _device;
+    uint8_t _pin;
+    uint8_t _source_index;
+};
+
+ACPI_STATUS WalkResourcesCallback(ACPI_RESOURCE *res, void *context) {
+    RT_ASSERT(res);
+    RT_ASSERT(context);
+    WalkResourcesIrqContext* ct = reinterpret_cast<WalkResourcesIrqContext*>(context);
+    RT_ASSERT(ct);
+    RT_ASSERT(ct->routes());
+
+    switch (res->Type) {
+    case ACPI_RESOURCE_TYPE_IRQ: {
+        ACPI_RESOURCE_IRQ* irq = &res->Data.Irq;
+        if (nullptr == irq || 0 == irq->InterruptCount) {
+            break;
+        }
+        if (ct->source_index() >= irq->InterruptCount) {
+            printf("[ACPI] Invalid _PRT source index %d for bus %d device %d\n",
+                   ct->source_index(), ct->bus(), ct->device());
+            break;
+        }
+        ct->routes()->AddRoute(AcpiPciIrqRoute(ct->segment(), ct->bus(),
+            ct->device(), ct->pin(),
+            irq->Interrupts[ct->source_index()]));
+    }
+        break;
+    case ACPI_RESOURCE_TYPE_EXTENDED_IRQ: {
+        ACPI_RESOURCE_EXTENDED_IRQ* irq = &res->Data.ExtendedIrq;
+        if (nullptr == irq || 0 == irq->InterruptCount) {
+            break;
+        }
+        if (ct->source_index() >= irq->InterruptCount) {
+            printf("[ACPI] Invalid _PRT source index %d for bus %d device %d\n",
+                   ct->source_index(), ct->bus(), ct->device());
+            break;
+        }
+        ct->routes()->AddRoute(AcpiPciIrqRoute(ct->segment(), ct->bus(),
+            ct->device(), ct->pin(),
+            irq->Interrupts[ct->source_index()]));
+    }
+        break;
+    default:
+        break;
+    }
+
+    return AE_OK;
+}
+
+ACPI_STATUS WalkResourcesBusLookupCallback(ACPI_RESOURCE *res, void* context) {
+    ACPI_RESOURCE_ADDRESS64 addr64;
+    int32_t* bus = reinterpret_cast<int32_t*>(context);
+
+    if ((res->Type != ACPI_RESOURCE_TYPE_ADDRESS16) &&
+        (res->Type != ACPI_RESOURCE_TYPE_ADDRESS32) &&
+        (res->Type != ACPI_RESOURCE_TYPE_ADDRESS64)) {
+        return AE_OK;
+    }
+
+    if (ACPI_FAILURE(AcpiResourceToAddress64(res, &addr64))) {
+        return AE_OK;
+    }
+
+    if (addr64.ResourceType != ACPI_BUS_NUMBER_RANGE) {
+        return AE_OK;
+    }
+
+    if (*bus != -1) {
+        return AE_ALREADY_EXISTS;
+    }
+
+    if (addr64.Minimum > 0xFFFF) {
+        return AE_BAD_DATA;
+    }
+
+    *bus = (int32_t)addr64.Minimum;
+    return AE_OK;
+}
+
+ACPI_STATUS EvalObjectTyped(ACPI_HANDLE handle, const char* pathname,
+        ACPI_OBJECT_LIST* external_params,
+        ACPI_BUFFER* return_buffer, ACPI_OBJECT_TYPE return_type) {
+
+    RT_ASSERT(4 == strnlen(pathname, 5));
+    char path[5];
+    strncpy(path, pathname, 4);
+    path[4] = '\0';
+    return AcpiEvaluateObjectTyped(handle, path, external_params, return_buffer, return_type);
+}
+
+ACPI_STATUS EvalInteger(ACPI_HANDLE handle, const char* name, ACPI_INTEGER* ret) {
+    RT_ASSERT(ret != nullptr);
+    ACPI_STATUS as;
+    char intbuf[sizeof(ACPI_OBJECT)];
+
+    ACPI_BUFFER intbufobj;
+    intbufobj.Length = sizeof(intbuf);
+    intbufobj.Pointer = intbuf;
+
+    as = EvalObjectTyped(handle, name, NULL, &intbufobj, ACPI_TYPE_INTEGER);
+    if (ACPI_SUCCESS(as)) {
+        ACPI_OBJECT* obj = reinterpret_cast<ACPI_OBJECT*>(intbufobj.Pointer);
+        *ret = obj->Integer.Value;
+    }
+
+    return as;
+}
+
+ACPI_STATUS WalkResources(ACPI_HANDLE device_handle, const char* pathname,
+        ACPI_WALK_RESOURCE_CALLBACK user_function, void* context) {
+    RT_ASSERT(4 == strnlen(pathname, 5));
+    char path[5];
+    strncpy(path, pathname, 4);
+    path[4] = '\0';
+    return AcpiWalkResources(device_handle, path, user_function, context);
+}
+
+bool AcpiManager::GetIrqRoutingTable(ACPI_HANDLE handle, uint16_t segment,
+                                     uint8_t bus, AcpiPciIrqRoutingTable* routes) {
+    RT_ASSERT(handle);
+    RT_ASSERT(routes);
+
+    ACPI_BUFFER buf;
+    buf.Length = ACPI_ALLOCATE_BUFFER;
+    buf.Pointer = nullptr;
+    ACPI_STATUS s = AcpiGetIrqRoutingTable(handle, &buf);
+    if (ACPI_FAILURE(s)) {
+        return false;
+    }
+
+    RT_ASSERT(buf.Pointer);
+    RT_ASSERT(buf.Length > 0);
+
+    ACPI_PCI_ROUTING_TABLE* table = reinterpret_cast<ACPI_PCI_ROUTING_TABLE*>(buf.Pointer);
+    for (; table->Length; table =
+            reinterpret_cast<ACPI_PCI_ROUTING_TABLE*>(
+            reinterpret_cast<uint8_t*>(table) + table->Length)) {
+
+        uint8_t device_id = table->Address >> 16;
+        uint8_t pin = table->Pin;
+        uint32_t source_index = table->SourceIndex;
+
+        char* src = reinterpret_cast<char*>(table->Source);
+        if ('\0' == src[0]) {
+            // Hardwired to global system interrupt
+            routes->AddRoute(AcpiPciIrqRoute(segment, bus, device_id, pin, source_index));
+            continue;
+        }
+
+        ACPI_HANDLE source;
+        s = AcpiGetHandle(handle, table->Source, &source);
+        if (ACPI_FAILURE(s)) {
+            printf("Failed AcpiGetHandle %s\n", AcpiFormatException(s));
+            continue;
+        }
+
+        WalkResourcesIrqContext context(routes, segment, bus, device_id, pin, source_index);
+        s = WalkResources(source, "_CRS", WalkResourcesCallback, &context);
+        if (ACPI_FAILURE(s)) {
+            printf("Failed IRQ resource\n");
+            continue;
+        }
+    }
+
+    ACPI_FREE(buf.Pointer);
+    return true;
+}
+
+int32_t AcpiManager::GetRootBridgeBusNumber(ACPI_HANDLE handle) {
+    // Method1: Use _BBN on root bridge
+    ACPI_INTEGER busnum;
+    ACPI_STATUS as = EvalInteger(handle, "_BBN", &busnum);
+    if (ACPI_SUCCESS(as)) {
+        return busnum & 0xFF;
+    }
+
+    // Method2: Search for bus number in resources
+    int32_t invalid_bus = -1;
+    int32_t bus = invalid_bus;
+    ACPI_STATUS s = WalkResources(handle, "_CRS", WalkResourcesBusLookupCallback, &bus);
+    if (ACPI_FAILURE(s)) {
+        return invalid_bus;
+    }
+
+    return bus;
+}
+
+void AcpiManager::ScanPciBus(ACPI_HANDLE bridge, uint16_t segment, uint8_t bus,
+                             AcpiPciIrqRoutingTable* routes) {
+    RT_ASSERT(bridge);
+    RT_ASSERT(routes);
+    GetIrqRoutingTable(bridge, segment, bus, routes);
+
+    ACPI_HANDLE child = nullptr;
+    while (ACPI_SUCCESS(AcpiGetNextObject(ACPI_TYPE_DEVICE, bridge, child, &child))) {
+        ACPI_INTEGER adr;
+        if (ACPI_FAILURE(EvalInteger(child, "_ADR", &adr))) {
+            continue;
+        }
+
+        uint8_t slot = (adr >> 16) & 0x1f;
+        uint8_t func = adr & 0x7;
+
+        // Only segment 0 is accessible using configuration ports
+        if (0 != segment) {
+            continue;
+        }
+
+        RT_ASSERT(GLOBAL_platform());
+        Platform* platform = GLOBAL_platform();
+        if (0xffff == platform->PciReadW(bus, slot, func, kPciVendorIdOffset)) {
+            continue;
+        }
+
+        // Mask multifunction bit, 1 is PCI-to-PCI and 2 is CardBus bridge
+        uint8_t header_type = platform->PciReadB(bus, slot, func, kPciHeaderTypeOffset) & 0x7f;
+        if (0x01 != header_type && 0x02 != header_type) {
+            continue;
+        }
+
+        uint8_t secondary_bus = platform->PciReadB(bus, slot, func, kPciSecondaryBusOffset);
+        if (0 == secondary_bus || secondary_bus <= bus) {
+            continue;
+        }
+
+        ScanPciBus(child, segment, secondary_bus, routes);
+    }
+}
+
+ACPI_STATUS WalkRootBridgeCallback(ACPI_HANDLE object, UINT32 nesting_level,
+                                   void* data, void** returns) {
+    RT_ASSERT(data);
+    AcpiObjectsList* list = reinterpret_cast<AcpiObjectsList*>(data);
+
+    ACPI_DEVICE_INFO* devinfo = nullptr;
+    if (ACPI_FAILURE(AcpiGetObjectInfo(object, &devinfo))) {
+        return AE_OK;
+    }
+
+    if (devinfo->Flags & ACPI_PCI_ROOT_BRIDGE) {
+        list->Push(object);
+    }
+
+    ACPI_FREE(devinfo);
+    return AE_OK;
+}
+
+void AcpiManager::UpdatePciIrqRoutes() {
+    AcpiObjectsList roots;
+    void* ptr = nullptr;
+    AcpiGetDevices(NULL, WalkRootBridgeCallback, &roots, &ptr);
+
+    AcpiPciIrqRoutingTable routes;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        ACPI_HANDLE root = roots.Get(i);
+
+        int32_t bus = GetRootBridgeBusNumber(root);
+        if (bus < 0) {
+            bus = 0;
+        }
+
+        ACPI_INTEGER segment = 0;
+        if (ACPI_FAILURE(EvalInteger(root, "_SEG", &segment))) {
+            segment = 0;
+        }
+
+        ScanPciBus(root, segment & 0xffff, bus & 0xff, &routes);
+    }
+
+    printf("[ACPI] PCI IRQ routes: %d\n", static_cast<int>(routes.size()));
+
+    ScopedLock lock(routes_locker_);
+    routes_ = routes;
+}
+
+ACPI_STATUS WalkResourcesSnapshotCallback(ACPI_RESOURCE* res, void* context) {
+    RT_ASSERT(res);
+    RT_ASSERT(context);
+    AcpiNamespaceNode* node = reinterpret_cast<AcpiNamespaceNode*>(context);
+    typedef AcpiDeviceResource::Type Type;
+
+    switch (res->Type) {
+    case ACPI_RESOURCE_TYPE_IRQ:
+        for (uint32_t i = 0; i < res->Data.Irq.InterruptCount; ++i) {
+            node->AddResource(AcpiDeviceResource(Type::IRQ,
+                res->Data.Irq.Interrupts[i], 1));
+        }
+        break;
+    case ACPI_RESOURCE_TYPE_EXTENDED_IRQ:
+        for (uint32_t i = 0; i < res->Data.ExtendedIrq.InterruptCount; ++i) {
+            node->AddResource(AcpiDeviceResource(Type::IRQ,
+                res->Data.ExtendedIrq.Interrupts[i], 1));
+        }
+        break;
+    case ACPI_RESOURCE_TYPE_IO:
+        node->AddResource(AcpiDeviceResource(Type::IO,
+            res->Data.Io.Minimum, res->Data.Io.AddressLength));
+        break;
+    case ACPI_RESOURCE_TYPE_FIXED_IO:
+        node->AddResource(AcpiDeviceResource(Type::IO,
+            res->Data.FixedIo.Address, res->Data.FixedIo.AddressLength));
+        break;
+    case ACPI_RESOURCE_TYPE_MEMORY24:
+        // 24-bit memory descriptors use 256 byte granularity
+        node->AddResource(AcpiDeviceResource(Type::MEMORY,
+            static_cast<uint64_t>(res->Data.Memory24.Minimum) << 8,
+            static_cast<uint64_t>(res->Data.Memory24.AddressLength) << 8));
+        break;
+    case ACPI_RESOURCE_TYPE_MEMORY32:
+        node->AddResource(AcpiDeviceResource(Type::MEMORY,
+            res->Data.Memory32.Minimum, res->Data.Memory32.AddressLength));
+        break;
+    case ACPI_RESOURCE_TYPE_FIXED_MEMORY32:
+        node->AddResource(AcpiDeviceResource(Type::MEMORY,
+            res->Data.FixedMemory32.Address, res->Data.FixedMemory32.AddressLength));
+        break;
+    case ACPI_RESOURCE_TYPE_ADDRESS16:
+    case ACPI_RESOURCE_TYPE_ADDRESS32:
+    case ACPI_RESOURCE_TYPE_ADDRESS64: {
+        ACPI_RESOURCE_ADDRESS64 addr64;
+        if (ACPI_FAILURE(AcpiResourceToAddress64(res, &addr64))) {
+            break;
+        }
+
+        if (0 == addr64.AddressLength) {
+            break;
+        }
+
+        switch (addr64.ResourceType) {
+        case ACPI_MEMORY_RANGE:
+            node->AddResource(AcpiDeviceResource(Type::MEMORY,
+                addr64.Minimum, addr64.AddressLength));
+            break;
+        case ACPI_IO_RANGE:
+            node->AddResource(AcpiDeviceResource(Type::IO,
+                addr64.Minimum, addr64.AddressLength));
+            break;
+        case ACPI_BUS_NUMBER_RANGE:
+            node->AddResource(AcpiDeviceResource(Type::BUS,
+                addr64.Minimum, addr64.AddressLength));
+            break;
+        default:
+            break;
+        }
+    }
+        break;
+    default:
+        break;
+    }
+
+    return AE_OK;
+}
+
+class WalkNamespaceSnapshotContext {
+public:
+    explicit WalkNamespaceSnapshotContext(AcpiNamespaceSnapshot* nodes)
+        :	_nodes(nodes) {
+        RT_ASSERT(_nodes);
+    }
+
+    /**
+     * Descending walk visits objects in preorder, so closest
+     * device ancestor is the last stack entry with lower nesting
+     * level after deeper entries are removed
+     */
+    int32_t PushLevel(uint32_t nesting_level) {
+        while (!_levels.empty() && _levels.back() >= nesting_level) {
+            _levels.pop_back();
+            _indexes.pop_back();
+        }
+
+        int32_t parent = _indexes.empty() ? -1 : _indexes.back();
+        _levels.push_back(nesting_level);
+        _indexes.push_back(_nodes->size());
+        return parent;
+    }
+
+    AcpiNamespaceSnapshot* nodes() const { return _nodes; }
+private:
+    AcpiNamespaceSnapshot* _nodes;
+    std::vector<uint32_t> _levels;
+    std::vector<int32_t> _indexes;
+};
+
+ACPI_STATUS WalkNamespaceSnapshotCallback(ACPI_HANDLE object, UINT32 nesting_level,
+                                          void* data, void** returns) {
+    RT_ASSERT(data);
+    WalkNamespaceSnapshotContext* ct = reinterpret_cast<WalkNamespaceSnapshotContext*>(data);
+
+    ACPI_DEVICE_INFO* devinfo = nullptr;
+    if (ACPI_FAILURE(AcpiGetObjectInfo(object, &devinfo))) {
+        devinfo = nullptr;
+    }
+
+    // Skip absent device together with its children
+    if (nullptr != devinfo && (ACPI_VALID_STA & devinfo->Valid)
+        && 0 == (devinfo->CurrentStatus & ACPI_STA_DEVICE_PRESENT)) {
+        ACPI_FREE(devinfo);
+        return AE_CTRL_DEPTH;
+    }
+
+    AcpiNamespaceNode node(object, ct->PushLevel(nesting_level));
+
+    if (nullptr != devinfo) {
+        node.SetName(devinfo->Name);
+
+        if (ACPI_VALID_HID & devinfo->Valid && nullptr != devinfo->HardwareId.String) {
+            node.SetHid(devinfo->HardwareId.String, devinfo->HardwareId.Length);
+        }
+
+        if (ACPI_VALID_ADR & devinfo->Valid) {
+            node.SetAddress(devinfo->Address & 0xffffffff);
+        }
+
+        if (devinfo->Flags & ACPI_PCI_ROOT_BRIDGE) {
+            node.SetRootBridge(AcpiManager::GetRootBridgeBusNumber(object));
+        }
+
+        ACPI_FREE(devinfo);
+    }
+
+    WalkResources(object, "_CRS", WalkResourcesSnapshotCallback, &node);
+    ct->nodes()->push_back(node);
+    return AE_OK;
+}
+
+AcpiNamespaceSnapshot AcpiManager::GetNamespaceSnapshot() {
+    AcpiNamespaceSnapshot nodes;
+    WalkNamespaceSnapshotContext context(&nodes);
+    AcpiWalkNamespace(ACPI_TYPE_DEVICE, ACPI_ROOT_OBJECT, ACPI_UINT32_MAX,
+                      WalkNamespaceSnapshotCallback, nullptr, &context, nullptr);
+    return nodes;
+}
+
 } // namespace rt
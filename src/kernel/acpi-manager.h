@@ -15,6 +15,7 @@
 #pragma once
 
 #include <kernel/kernel.h>
+#include <kernel/spinlock.h>
 #include <acpi.h>
 #include <vector>
 #include <stdio.h>
@@ -44,17 +45,24 @@ private:
 
 class AcpiPciIrqRoute {
 public:
-    AcpiPciIrqRoute(uint8_t device, uint8_t pin, uint8_t irq)
-        :	_device(device),
+    AcpiPciIrqRoute(uint16_t segment, uint8_t bus, uint8_t device,
+                    uint8_t pin, uint32_t irq)
+        :	_segment(segment),
+            _bus(bus),
+            _device(device),
             _pin(pin),
             _irq(irq) { }
+    uint16_t segment() const { return _segment; }
+    uint8_t bus() const { return _bus; }
     uint8_t device() const { return _device; }
     uint8_t pin() const { return _pin; }
-    uint8_t irq() const { return _irq; }
+    uint32_t irq() const { return _irq; }
 private:
+    uint16_t _segment;
+    uint8_t _bus;
     uint8_t _device;
     uint8_t _pin;
-    uint8_t _irq;
+    uint32_t _irq;
 };
 
 class AcpiPciIrqRoutingTable {
@@ -75,14 +83,151 @@ private:
     std::vector<AcpiPciIrqRoute> _routes;
 };
 
+class AcpiDeviceResource {
+public:
+    enum class Type {
+        IRQ,
+        IO,
+        MEMORY,
+        BUS
+    };
+
+    AcpiDeviceResource(Type type, uint64_t base, uint64_t length)
+        :	_type(type),
+            _base(base),
+            _length(length) { }
+    Type type() const { return _type; }
+    uint64_t base() const { return _base; }
+    uint64_t length() const { return _length; }
+private:
+    Type _type;
+    uint64_t _base;
+    uint64_t _length;
+};
+
+/**
+ * Plain copy of ACPI device object data, parent is an index
+ * of the closest device ancestor in the same snapshot or -1
+ */
+class AcpiNamespaceNode {
+public:
+    AcpiNamespaceNode(ACPI_HANDLE handle, int32_t parent)
+        :	_handle(handle),
+            _parent(parent),
+            _address(0),
+            _has_address(false),
+            _root_bridge(false),
+            _bus(-1) {
+        RT_ASSERT(_handle);
+        _name[0] = '\0';
+        _hid[0] = '\0';
+    }
+
+    static const size_t kMaxHidLength = 16;
+
+    ACPI_HANDLE handle() const { return _handle; }
+    int32_t parent() const { return _parent; }
+    const char* name() const { return _name; }
+    const char* hid() const { return _hid; }
+    uint32_t address() const { return _address; }
+    bool has_address() const { return _has_address; }
+    bool root_bridge() const { return _root_bridge; }
+    int32_t bus() const { return _bus; }
+    const std::vector<AcpiDeviceResource>& resources() const { return _resources; }
+
+    void SetName(uint32_t name) {
+        for (int i = 0; i < 4; ++i) {
+            _name[i] = (name >> (i * 8)) & 0xff;
+        }
+        _name[4] = '\0';
+    }
+
+    void SetHid(const char* hid, uint32_t len) {
+        RT_ASSERT(hid);
+        uint32_t i = 0;
+        for (; i < len && i < kMaxHidLength - 1 && '\0' != hid[i]; ++i) {
+            _hid[i] = hid[i];
+        }
+        _hid[i] = '\0';
+    }
+
+    void SetAddress(uint32_t address) {
+        _address = address;
+        _has_address = true;
+    }
+
+    void SetRootBridge(int32_t bus) {
+        _root_bridge = true;
+        _bus = bus;
+    }
+
+    void AddResource(AcpiDeviceResource resource) {
+        _resources.push_back(resource);
+    }
+private:
+    ACPI_HANDLE _handle;
+    int32_t _parent;
+    char _name[5];
+    char _hid[kMaxHidLength];
+    uint32_t _address;
+    bool _has_address;
+    bool _root_bridge;
+    int32_t _bus;
+    std::vector<AcpiDeviceResource> _resources;
+};
+
+typedef std::vector<AcpiNamespaceNode> AcpiNamespaceSnapshot;
 
 class AcpiManager {
 public:
     AcpiManager();
     AcpiObjectsList GetPciDevices();
+
+    /**
+     * Walk all device objects in ACPI namespace once and
+     * copy their identifiers, addresses and _CRS resources
+     */
+    AcpiNamespaceSnapshot GetNamespaceSnapshot();
+
+    /**
+     * Evaluate _PRT of PCI root or bridge device and add
+     * its routes using provided segment and bus numbers
+     */
+    static bool GetIrqRoutingTable(ACPI_HANDLE handle, uint16_t segment,
+                                   uint8_t bus, AcpiPciIrqRoutingTable* routes);
+
+    /**
+     * Get root bridge bus number using _BBN or bus range in _CRS,
+     * returns -1 if unknown
+     */
+    static int32_t GetRootBridgeBusNumber(ACPI_HANDLE handle);
+
+    /**
+     * Evaluate _PRT of all PCI roots and bridges and rebuild
+     * routing map. Done once on init, should be called again
+     * when PCI hierarchy changes
+     */
+    void UpdatePciIrqRoutes();
+
+    /**
+     * Copy of routing map for all PCI buses
+     */
+    AcpiPciIrqRoutingTable pci_irq_routes() {
+        ScopedLock lock(routes_locker_);
+        return routes_;
+    }
 private:
     bool Init();
     bool SetInterruptRoutingMode();
+    void ScanPciBus(ACPI_HANDLE bridge, uint16_t segment, uint8_t bus,
+                    AcpiPciIrqRoutingTable* routes);
+
+    static const uint8_t kPciVendorIdOffset = 0x00;
+    static const uint8_t kPciHeaderTypeOffset = 0x0e;
+    static const uint8_t kPciSecondaryBusOffset = 0x19;
+
+    AcpiPciIrqRoutingTable routes_;
+    Locker routes_locker_;
     DELETE_COPY_AND_ASSIGN(AcpiManager);
 };
 
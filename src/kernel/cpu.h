@@ -58,6 +58,13 @@ public:
     static void DisableInterrupts() {
         CpuPlatform::DisableInterrupts();
     }
+
+    /**
+     * Check if interrupts are enabled on current CPU
+     */
+    static bool InterruptsEnabled() {
+        return CpuPlatform::InterruptsEnabled();
+    }
 };
 
 } // namespace rt
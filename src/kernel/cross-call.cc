@@ -0,0 +1,217 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cross-call.h"
+#include <kernel/kernel.h>
+#include <kernel/cpu.h>
+#include <kernel/platform.h>
+
+namespace rt {
+
+CrossCalls::CrossCalls(uint32_t cpu_count) {
+    RT_ASSERT(cpu_count > 0);
+    queues_.reserve(cpu_count);
+    for (uint32_t i = 0; i < cpu_count; ++i) {
+        queues_.push_back(new CrossCallQueue());
+    }
+}
+
+void CrossCalls::Enqueue(uint32_t cpu, CrossCallRequest request) {
+    RT_ASSERT(cpu < queues_.size());
+    CrossCallQueue* queue = queues_[cpu];
+    RT_ASSERT(queue);
+    RT_ASSERT(queue->online.Get());
+
+    bool was_empty = false;
+    while (!queue->Push(request, &was_empty)) {
+        // Target CPU can wait for us to handle its own requests
+        if (!Cpu::InterruptsEnabled()) {
+            ProcessPending();
+        }
+        Cpu::WaitPause();
+    }
+
+    // Queue was not empty, IPI is already on the way and
+    // request will be handled by the same interrupt
+    if (was_empty) {
+        RT_ASSERT(GLOBAL_platform());
+        GLOBAL_platform()->SendCrossCallIPI(cpu);
+    }
+}
+
+void CrossCalls::WaitCompletion(Atomic<uint32_t>* pending) {
+    RT_ASSERT(pending);
+    while (0 != pending->Get()) {
+        // Handle incoming calls manually if interrupts are
+        // disabled, otherwise two CPUs calling each other
+        // would deadlock
+        if (!Cpu::InterruptsEnabled()) {
+            ProcessPending();
+        }
+        Cpu::WaitPause();
+    }
+}
+
+void CrossCalls::Call(uint32_t cpu, CrossCallFunction fn, void* data, bool wait) {
+    RT_ASSERT(fn);
+    if (cpu == Cpu::id()) {
+        fn(data);
+        return;
+    }
+
+    if (!wait) {
+        Enqueue(cpu, {fn, data, nullptr});
+        return;
+    }
+
+    Atomic<uint32_t> pending;
+    pending.Set(1);
+    Enqueue(cpu, {fn, data, &pending});
+    WaitCompletion(&pending);
+}
+
+TlbFlushBatch* CrossCalls::AcquireAsyncBatch(const TlbFlushBatch& batch) {
+    for (;;) {
+        {   ScopedLock lock(async_batches_locker_);
+            for (TlbFlushBatch& slot : async_batches_) {
+                if (0 != slot.refs_.Get()) {
+                    continue;
+                }
+
+                slot.count_ = batch.count_;
+                slot.flush_all_ = batch.flush_all_;
+                for (uint32_t i = 0; i < batch.count_; ++i) {
+                    slot.pages_[i] = batch.pages_[i];
+                }
+
+                // Owner reference, released after all flushes are sent
+                slot.refs_.Set(1);
+                return &slot;
+            }
+        }
+
+        if (!Cpu::InterruptsEnabled()) {
+            ProcessPending();
+        }
+        Cpu::WaitPause();
+    }
+}
+
+void CrossCalls::Shootdown(const TlbFlushBatch& batch, bool wait) {
+    if (batch.empty()) {
+        return;
+    }
+
+    uint32_t self = Cpu::id();
+    Atomic<uint32_t> pending;
+    TlbFlushBatch* async_batch = nullptr;
+
+    for (uint32_t cpu = 0; cpu < queues_.size(); ++cpu) {
+        if (cpu == self || !queues_[cpu]->online.Get()) {
+            continue;
+        }
+
+        if (queues_[cpu]->lazy_tlb.Get()) {
+            continue;
+        }
+
+        if (wait) {
+            pending.AddFetch(1);
+            Enqueue(cpu, {TlbFlushBatch::FlushFunction,
+                          const_cast<TlbFlushBatch*>(&batch), &pending});
+            continue;
+        }
+
+        // Async flush can outlive caller's batch, use a copy
+        if (nullptr == async_batch) {
+            async_batch = AcquireAsyncBatch(batch);
+        }
+
+        async_batch->refs_.AddFetch(1);
+        Enqueue(cpu, {TlbFlushBatch::FlushAsyncFunction, async_batch, nullptr});
+    }
+
+    if (wait) {
+        WaitCompletion(&pending);
+    }
+
+    if (nullptr != async_batch) {
+        async_batch->refs_.SubFetch(1);
+    }
+}
+
+void CrossCalls::ProcessPending() {
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < queues_.size());
+    CrossCallQueue* queue = queues_[cpu];
+
+    CrossCallRequest request;
+    while (queue->Pop(&request)) {
+        RT_ASSERT(request.fn);
+        request.fn(request.data);
+        if (nullptr != request.pending) {
+            request.pending->SubFetch(1);
+        }
+    }
+}
+
+void CrossCalls::CpuOnline() {
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < queues_.size());
+    queues_[cpu]->online.Set(1);
+}
+
+void CrossCalls::CpuOffline() {
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < queues_.size());
+    queues_[cpu]->online.Set(0);
+}
+
+void CrossCalls::EnterIdle() {
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < queues_.size());
+    queues_[cpu]->lazy_tlb.Set(1);
+}
+
+void TlbFlushBatch::Flush(bool wait) {
+    FlushLocal();
+    RT_ASSERT(GLOBAL_platform());
+    GLOBAL_platform()->cross_calls().Shootdown(*this, wait);
+}
+
+void TlbFlushBatch::FlushLocal() const {
+    RT_ASSERT(GLOBAL_platform());
+    if (flush_all_) {
+        GLOBAL_platform()->InvalidateAll();
+        return;
+    }
+
+    for (uint32_t i = 0; i < count_; ++i) {
+        GLOBAL_platform()->InvalidatePage(pages_[i]);
+    }
+}
+
+void TlbFlushBatch::FlushFunction(void* data) {
+    RT_ASSERT(data);
+    static_cast<TlbFlushBatch*>(data)->FlushLocal();
+}
+
+void TlbFlushBatch::FlushAsyncFunction(void* data) {
+    RT_ASSERT(data);
+    TlbFlushBatch* batch = static_cast<TlbFlushBatch*>(data);
+    batch->FlushLocal();
+    batch->refs_.SubFetch(1);
+}
+
+} // namespace rt
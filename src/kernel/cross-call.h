@@ -0,0 +1,215 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/spinlock.h>
+
+namespace rt {
+
+/**
+ * Function executed on remote CPU in IRQ context, it
+ * should not issue cross calls itself
+ */
+typedef void (*CrossCallFunction)(void* data);
+
+/**
+ * Queued remote call. Synchronous caller waits until
+ * pending counter reaches zero
+ */
+struct CrossCallRequest {
+    CrossCallFunction fn;
+    void* data;
+    Atomic<uint32_t>* pending;
+};
+
+/**
+ * Per-CPU mailbox of cross calls. Requests are stored in fixed ring
+ * because IRQ handler can't use allocator
+ */
+class CrossCallQueue {
+public:
+    CrossCallQueue()
+        :	head_(0),
+            tail_(0) {}
+
+    static const uint32_t kSize = 64;
+
+    /**
+     * Add request to the queue. Returns false if queue is full,
+     * sets was_empty to false if IPI for previous request is
+     * still not handled
+     */
+    bool Push(CrossCallRequest request, bool* was_empty) {
+        RT_ASSERT(was_empty);
+        ScopedLock lock(locker_);
+        if (head_ - tail_ >= kSize) {
+            return false;
+        }
+
+        *was_empty = (head_ == tail_);
+        requests_[head_++ % kSize] = request;
+        return true;
+    }
+
+    bool Pop(CrossCallRequest* request) {
+        RT_ASSERT(request);
+        ScopedLock lock(locker_);
+        if (head_ == tail_) {
+            return false;
+        }
+
+        *request = requests_[tail_++ % kSize];
+        return true;
+    }
+
+    /**
+     * CPU is receiving IPIs
+     */
+    Atomic<uint32_t> online;
+
+    /**
+     * CPU is in idle loop and never touches mapped memory
+     * again, TLB shootdowns skip it
+     */
+    Atomic<uint32_t> lazy_tlb;
+
+private:
+    CrossCallRequest requests_[kSize];
+    uint32_t head_;
+    uint32_t tail_;
+    Locker locker_;
+    DELETE_COPY_AND_ASSIGN(CrossCallQueue);
+};
+
+/**
+ * Batch of page invalidations sent to all CPUs with single
+ * cross call. Large batches fall back to full TLB flush
+ */
+class TlbFlushBatch {
+    friend class CrossCalls;
+public:
+    TlbFlushBatch()
+        :	count_(0),
+            flush_all_(false) {}
+
+    static const uint32_t kMaxPages = 32;
+
+    /**
+     * Add page to batch
+     */
+    void Add(void* virtaddr) {
+        if (flush_all_) {
+            return;
+        }
+
+        if (count_ >= kMaxPages) {
+            flush_all_ = true;
+            return;
+        }
+
+        pages_[count_++] = virtaddr;
+    }
+
+    /**
+     * Flush whole TLB instead of single pages
+     */
+    void AddAll() { flush_all_ = true; }
+
+    bool empty() const { return 0 == count_ && !flush_all_; }
+
+    /**
+     * Invalidate batch on current CPU and do shootdown on
+     * others. Async flush returns before other CPUs are done
+     */
+    void Flush(bool wait);
+
+    /**
+     * Invalidate batch on current CPU only
+     */
+    void FlushLocal() const;
+
+private:
+    void* pages_[kMaxPages];
+    uint32_t count_;
+    bool flush_all_;
+    Atomic<uint32_t> refs_;     // Pending async flushes using this batch
+
+    static void FlushFunction(void* data);
+    static void FlushAsyncFunction(void* data);
+    DELETE_COPY_AND_ASSIGN(TlbFlushBatch);
+};
+
+/**
+ * IPI-driven execution of functions on other CPUs
+ */
+class CrossCalls {
+public:
+    CrossCalls(uint32_t cpu_count);
+
+    /**
+     * Run function on CPU, blocks until it's done
+     * if wait is true. Data should stay valid until function
+     * completes
+     */
+    void Call(uint32_t cpu, CrossCallFunction fn, void* data, bool wait);
+
+    /**
+     * Invalidate TLB batch on all CPUs. CPUs in idle loop are not
+     * interrupted
+     */
+    void Shootdown(const TlbFlushBatch& batch, bool wait);
+
+    /**
+     * Execute all requests queued for current CPU (requires IRQ
+     * context or disabled interrupts)
+     */
+    void ProcessPending();
+
+    /**
+     * Mark current CPU as able to receive cross calls
+     */
+    void CpuOnline();
+
+    /**
+     * Mark current CPU as stopped, it should not receive
+     * cross calls anymore
+     */
+    void CpuOffline();
+
+    /**
+     * Current CPU enters idle loop, it is excluded from TLB
+     * shootdowns. Idle loop never returns
+     */
+    void EnterIdle();
+
+    uint32_t cpu_count() const { return queues_.size(); }
+
+    static const uint32_t kAsyncBatches = 16;
+
+private:
+    std::vector<CrossCallQueue*> queues_;
+    TlbFlushBatch async_batches_[kAsyncBatches];
+    Locker async_batches_locker_;
+
+    void Enqueue(uint32_t cpu, CrossCallRequest request);
+    void WaitCompletion(Atomic<uint32_t>* pending);
+    TlbFlushBatch* AcquireAsyncBatch(const TlbFlushBatch& batch);
+    DELETE_COPY_AND_ASSIGN(CrossCalls);
+};
+
+} // namespace rt
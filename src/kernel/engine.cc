@@ -14,11 +14,30 @@
 
 #include "engine.h"
 #include <v8.h>
+#include <kernel/platform.h>
 
 namespace rt {
 
+void Engine::IdleLoop() {
+    RT_ASSERT(GLOBAL_platform());
+    GLOBAL_platform()->cross_calls().EnterIdle();
+    for (;;) {
+        Cpu::WaitPause();
+    }
+}
+
+void Engine::StopCpu() {
+    RT_ASSERT(GLOBAL_platform());
+    GLOBAL_platform()->cross_calls().CpuOffline();
+    Cpu::HangSystem();
+}
+
 Isolate* EngineThread::isolate() const {
     RT_ASSERT(engine_);
+    if (nullptr != isolate_) {
+        return isolate_;
+    }
+
     return engine_->isolate();
 }
 
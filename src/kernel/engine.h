@@ -26,6 +26,7 @@
 namespace rt {
 
 class Thread;
+class IrqDataSource;
 
 class ThreadMessage {
 public:
@@ -35,6 +36,7 @@ public:
         EVALUATE,
         TIMEOUT_EVENT,
         IRQ_RAISE,
+        IRQ_DATA,
         FUNCTION_CALL,
         FUNCTION_RETURN_RESOLVE,
         FUNCTION_RETURN_REJECT,
@@ -49,6 +51,7 @@ public:
             data_(std::move(data)),
             efn_(efn),
             recv_index_(recv_index),
+            data_source_(nullptr),
             reusable_(false) {}
 
     Type type() const { return type_; }
@@ -68,6 +71,18 @@ public:
         reusable_ = true;
     }
 
+    /**
+     * Source to take buffered bytes from for IRQ_DATA message
+     */
+    IrqDataSource* data_source() {
+        RT_ASSERT(data_source_);
+        return data_source_;
+    }
+
+    void SetDataSource(IrqDataSource* source) {
+        data_source_ = source;
+    }
+
     size_t recv_index() const { return recv_index_; }
     bool reusable() const { return reusable_; }
     DELETE_COPY_AND_ASSIGN(ThreadMessage);
@@ -77,6 +92,7 @@ private:
     TransportData data_;
     ExternalFunction* efn_;
     size_t recv_index_;
+    IrqDataSource* data_source_;
     bool reusable_;
 };
 
@@ -93,8 +109,12 @@ public:
 
     v8::Local<v8::Object> NewInstance(Isolate* isolate);
 
-    EngineThread(Engine* engine)
+    /**
+     * Thread runs in engine isolate if provided isolate is null
+     */
+    EngineThread(Engine* engine, Isolate* isolate)
         :	engine_(engine),
+            isolate_(isolate),
             status_(Status::EMPTY),
             thread_(nullptr) {
         RT_ASSERT(engine_);
@@ -125,22 +145,27 @@ public:
 
     /**
      * Put message into realm processing queue. Use only
-     * for IRQ-context calls. It doesn't touch IRQ flag
+     * for IRQ-context calls. It doesn't touch IRQ flag.
+     * Returns false if message has been dropped
      */
-    void PushMessageIRQ(SystemContextIRQ irq_context, ThreadMessage* message) {
+    bool PushMessageIRQ(SystemContextIRQ irq_context, ThreadMessage* message) {
         ScopedLock lock(c_locker_);
         RT_ASSERT(message);
 
         // We don't want to allocate memory in IRQ handler
         if (messages_.size() < messages_.capacity()) {
             messages_.push_back(message);
+            return true;
         }
+
+        return false;
     }
 
     Isolate* isolate() const;
 
 private:
     Engine* engine_;
+    Isolate* isolate_;
     Status status_;
     Thread* thread_;
     Locker c_locker_;
@@ -164,16 +189,30 @@ public:
             RT_ASSERT(engine_);
         }
 
-        ResourceHandle<EngineThread> Create() {
+        /**
+         * Create new thread. Dedicated isolate created with
+         * NewDedicatedIsolate keeps thread heap and GC separate
+         * from other engine threads, null runs it in engine isolate
+         */
+        ResourceHandle<EngineThread> Create(Isolate* isolate = nullptr) {
             ScopedLock lock(datalocker_);
             RT_ASSERT(engine_);
-            EngineThread* t = new EngineThread(engine_);
+            EngineThread* t = new EngineThread(engine_, isolate);
             threads_.push_back(t);
             ResourceHandle<EngineThread> th(t);
             new_threads_.push_back(th);
             return th;
         }
 
+        /**
+         * Create isolate for single thread, this is slow and
+         * doesn't need the lock. Pass it to Create or release with
+         * Isolate::DisposeUnattached if thread is not created
+         */
+        Isolate* NewDedicatedIsolate() {
+            return new Isolate(engine_);
+        }
+
         SharedVector<ResourceHandle<EngineThread>> TakeNewThreads() {
             SharedVector<ResourceHandle<EngineThread>> transport;
 
@@ -192,8 +231,9 @@ public:
         Locker datalocker_;
     };
 
-    Engine(EngineType type)
+    Engine(EngineType type, uint32_t cpu_id)
         :	type_(type),
+            cpu_id_(cpu_id),
             isolate_(nullptr),
             init_(false),
             threads_(this) {}
@@ -203,6 +243,13 @@ public:
     bool is_init() const { return init_; }
     Threads& threads() { return threads_; }
     EngineType type() const { return type_; }
+    uint32_t cpu_id() const { return cpu_id_; }
+
+    /**
+     * Number of processes placed on this engine
+     */
+    uint32_t process_count() const { return process_count_.Get(); }
+    void AddProcess() { process_count_.AddFetch(1); }
 
 
     void Enter() {
@@ -211,11 +258,11 @@ public:
 
         switch (type_) {
         case EngineType::DISABLED: {
-            Cpu::HangSystem();
+            StopCpu();
         }
             break;
         case EngineType::SERVICE: {
-            for (;;) Cpu::WaitPause();
+            IdleLoop();
             Cpu::HangSystem();
         }
             break;
@@ -237,6 +284,17 @@ public:
         }
     }
 
+    /**
+     * Spin on CPU without isolate. TLB shootdowns for
+     * this CPU are skipped
+     */
+    void IdleLoop();
+
+    /**
+     * Halt CPU, it doesn't receive cross calls anymore
+     */
+    __attribute__((__noreturn__)) void StopCpu();
+
     void TimerTick(SystemContextIRQ& irq_context) const {
         if (isolate_) {
             isolate_->TimerInterruptNotify();
@@ -261,6 +319,8 @@ public:
 
 private:
     EngineType type_;
+    uint32_t cpu_id_;
+    Atomic<uint32_t> process_count_;
     Isolate* isolate_;
     bool init_;
     LocalStorage local_storage_;
@@ -14,6 +14,7 @@
 
 #include "engines.h"
 #include <kernel/acpi-manager.h>
+#include <kernel/platform.h>
 
 namespace rt {
 
@@ -26,4 +27,48 @@ AcpiManager* Engines::acpi_manager() {
     return _acpi_manager;
 }
 
+Engine* Engines::PlaceProcess() {
+    RT_ASSERT(engines_execution_.size() > 0);
+    RT_ASSERT(GLOBAL_platform());
+
+    Engine* best = nullptr;
+    uint32_t best_core_load = 0;
+    uint32_t best_load = 0;
+
+    for (Engine* engine : engines_execution_) {
+        RT_ASSERT(engine);
+
+        // Engine CPU is not started yet
+        if (!engine->is_init()) {
+            continue;
+        }
+
+        CpuTopology t = GLOBAL_platform()->cpu_topology(engine->cpu_id());
+
+        // Load of physical core is shared by all its SMT threads
+        uint32_t core_load = 0;
+        for (Engine* other : engines_execution_) {
+            if (!other->is_init()) {
+                continue;
+            }
+
+            CpuTopology ot = GLOBAL_platform()->cpu_topology(other->cpu_id());
+            if (ot.package_id == t.package_id && ot.core_id == t.core_id) {
+                core_load += other->process_count();
+            }
+        }
+
+        uint32_t load = engine->process_count();
+        if (nullptr == best || core_load < best_core_load ||
+            (core_load == best_core_load && load < best_load)) {
+            best = engine;
+            best_core_load = core_load;
+            best_load = load;
+        }
+    }
+
+    RT_ASSERT(best);
+    return best;
+}
+
 } // namespace rt
@@ -41,7 +41,8 @@ public:
     Engines(uint32_t cpu_count)
         :	cpu_count_(cpu_count),
             _non_isolate_ticks(0),
-            proc_mgr_(this) {
+            proc_mgr_(this),
+            array_buffer_allocator_(new MallocArrayBufferAllocator()) {
         RT_ASSERT(nullptr == GLOBAL_engines());
         RT_ASSERT(this);
         RT_ASSERT(cpu_count >= 1);
@@ -54,9 +55,9 @@ public:
         for (uint32_t i = 0; i < cpu_count; ++i) {
             Engine* engine = nullptr;
             if (9999 == i) {
-                engine = new Engine(EngineType::SERVICE);
+                engine = new Engine(EngineType::SERVICE, i);
             } else {
-                engine = new Engine(EngineType::EXECUTION);
+                engine = new Engine(EngineType::EXECUTION, i);
                 engines_execution_.push_back(engine);
                 engine->threads().Create(); // create idle thread
             }
@@ -68,7 +69,7 @@ public:
         RT_ASSERT(engines_execution_.size() > 0);
 
         v8::V8::InitializeICU();
-        v8::V8::SetArrayBufferAllocator(new MallocArrayBufferAllocator());
+        v8::V8::SetArrayBufferAllocator(array_buffer_allocator_);
 
         const char flags[] = "--harmony_collections";
         v8::V8::SetFlagsFromString(flags, sizeof(flags));
@@ -80,6 +81,7 @@ public:
         RT_ASSERT(engines_execution_.size() > 0);
         Engine* first_engine = engines_execution_[0];
         RT_ASSERT(first_engine);
+        first_engine->AddProcess();
         ResourceHandle<EngineThread> st = first_engine->threads().Create();
         p.get()->SetThread(st, 0);
 
@@ -113,6 +115,14 @@ public:
         return engines_execution_[index];
     }
 
+    /**
+     * Choose execution engine for new process. Engines on idle
+     * physical cores are preferred over SMT siblings of busy ones.
+     * Only engines already running on their CPUs are used. Caller
+     * counts process with Engine::AddProcess once it's created
+     */
+    Engine* PlaceProcess();
+
     bool is_execution_engine(uint32_t engineid) const {
         RT_ASSERT(GLOBAL_engines());
         RT_ASSERT(this == GLOBAL_engines());
@@ -217,6 +227,14 @@ public:
     AcpiManager* acpi_manager();
     ProcessManager& process_manager() { return proc_mgr_; }
 
+    /**
+     * Allocator used for all ArrayBuffer contents, required to
+     * release contents externalized by kernel
+     */
+    v8::ArrayBuffer::Allocator* array_buffer_allocator() {
+        return array_buffer_allocator_;
+    }
+
     ~Engines() = delete;
     DELETE_COPY_AND_ASSIGN(Engines);
 private:
@@ -226,6 +244,7 @@ private:
     AcpiManager* _acpi_manager;
     volatile uint64_t _non_isolate_ticks;
     ProcessManager proc_mgr_;
+    v8::ArrayBuffer::Allocator* array_buffer_allocator_;
 
     Atomic<uint64_t> global_ticks_counter_;
 
@@ -0,0 +1,51 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+namespace rt {
+
+/**
+ * Device data buffered in IRQ context and delivered
+ * to engine thread in batches. Implemented by platform
+ */
+class IrqDataSource {
+public:
+    virtual ~IrqDataSource() {}
+
+    /**
+     * Max number of bytes delivered with single message
+     */
+    static const uint32_t kMaxBatch = 256;
+
+    /**
+     * Read all available data from device, called from IRQ
+     * context. Returns true if engine thread needs to be notified
+     */
+    virtual bool Drain() = 0;
+
+    /**
+     * Notification was not delivered, next IRQ should retry
+     */
+    virtual void CancelPending() = 0;
+
+    /**
+     * Take buffered bytes, called from engine thread
+     */
+    virtual uint32_t Take(uint8_t* out, uint32_t max) = 0;
+};
+
+} // namespace rt
@@ -19,6 +19,7 @@
 #include <kernel/system-context.h>
 #include <kernel/spinlock.h>
 #include <kernel/engine.h>
+#include <kernel/irq-data-source.h>
 
 namespace rt {
 
@@ -34,20 +35,51 @@ public:
         reusable_msg_->MakeReusable();
     }
 
+    /**
+     * Binding that drains device data source on every
+     * IRQ and notifies thread once per batch
+     */
+    IRQBinding(ResourceHandle<EngineThread> thread, size_t recv_index,
+               std::unique_ptr<IrqDataSource> source)
+        :	thread_(thread), recv_index_(recv_index),
+            reusable_msg_(new ThreadMessage(ThreadMessage::Type::IRQ_DATA,
+            ResourceHandle<EngineThread>(), TransportData(), nullptr, recv_index_)),
+            data_source_(std::move(source)) {
+        RT_ASSERT(data_source_);
+        reusable_msg_->MakeReusable();
+        reusable_msg_->SetDataSource(data_source_.get());
+    }
+
     IRQBinding(IRQBinding&& other)
         :	thread_(other.thread_),
             recv_index_(other.recv_index_),
-            reusable_msg_(std::move(other.reusable_msg_)) {}
+            reusable_msg_(std::move(other.reusable_msg_)),
+            data_source_(std::move(other.data_source_)) {}
 
     void Raise(SystemContextIRQ irq_context) const {
         RT_ASSERT(reusable_msg_);
         RT_ASSERT(reusable_msg_->reusable());
+
+        if (data_source_) {
+            if (!data_source_->Drain()) {
+                return;
+            }
+
+            if (!thread_.getUnsafe()->PushMessageIRQ(irq_context, reusable_msg_.get())) {
+                data_source_->CancelPending();
+            }
+            return;
+        }
+
         thread_.getUnsafe()->PushMessageIRQ(irq_context, reusable_msg_.get());
     }
+
+    bool has_data_source() const { return nullptr != data_source_; }
 private:
     ResourceHandle<EngineThread> thread_;
     size_t recv_index_;
     std::unique_ptr<ThreadMessage> reusable_msg_;
+    std::unique_ptr<IrqDataSource> data_source_;
     DELETE_COPY_AND_ASSIGN(IRQBinding);
 };
 
@@ -68,6 +100,26 @@ public:
         bindings_[number].push_back(std::move(IRQBinding(thread, recv_index)));
     }
 
+    /**
+     * Bind device data source for provided IRQ number,
+     * thread receives buffered bytes in batches. Only one source
+     * can drain device, returns false if IRQ already has one
+     */
+    bool BindDataSource(uint8_t number, ResourceHandle<EngineThread> thread, size_t recv_index,
+                        std::unique_ptr<IrqDataSource> source) {
+        NoInterrupsScope no_interrupts;
+        ScopedLock lock(bindings_locker_);
+        RT_ASSERT(number < kIrqCount);
+        for (const IRQBinding& binding : bindings_[number]) {
+            if (binding.has_data_source()) {
+                return false;
+            }
+        }
+
+        bindings_[number].push_back(std::move(IRQBinding(thread, recv_index, std::move(source))));
+        return true;
+    }
+
     /**
      * Execute all handlers for provided IRQ number
      */
@@ -148,12 +148,18 @@ EXPORT_EVENT void irq_handler_any(uint64_t number) {
 // TODO: fix this event
 EXPORT_EVENT void irq_timer_event() {
     rt::SystemContextTimerIRQ irq_context {};
+    RT_ASSERT(GLOBAL_platform());
+    GLOBAL_platform()->TimerTick();
+
     RT_ASSERT(GLOBAL_engines());
     GLOBAL_engines()->TimerTick(irq_context);
+    GLOBAL_platform()->AckIRQ();
+}
 
-    // TODO: fix hardcoded apic base address
-    LocalApicRegisterAccessor registers((void*)0xfee00000);
-    registers.Write(LocalApicRegister::EOI, 0);
+EXPORT_EVENT void irq_cross_call_event() {
+    RT_ASSERT(GLOBAL_platform());
+    GLOBAL_platform()->cross_calls().ProcessPending();
+    GLOBAL_platform()->AckIRQ();
 }
 
 EXPORT_EVENT void irq_other_event() {
@@ -30,6 +30,20 @@ public:
     Irqs() {
         irqs_arch_.SetUp();
     }
+
+    /**
+     * Setup exception stacks for current CPU
+     */
+    void InitCurrentCPU() {
+        irqs_arch_.InitCurrentCPU();
+    }
+
+    /**
+     * Allocate exception stacks of all CPUs before APs are started
+     */
+    void PrepareCpus(uint32_t cpu_count) {
+        irqs_arch_.PrepareCpus(cpu_count);
+    }
 private:
     IrqsArch irqs_arch_;
     DELETE_COPY_AND_ASSIGN(Irqs);
@@ -24,6 +24,8 @@ Isolate::Isolate(Engine* engine, uint32_t id, bool startup_script)
     :	engine_(engine),
         id_(id),
         startup_script_(startup_script),
+        dedicated_(false),
+        parent_(nullptr),
         isolate_(v8::Isolate::New()),
         thread_manager_(nullptr),
         tpl_cache_(nullptr) {
@@ -36,6 +38,43 @@ Isolate::Isolate(Engine* engine, uint32_t id, bool startup_script)
     RT_ASSERT(thread_manager_);
 }
 
+Isolate::Isolate(Engine* engine)
+    :	engine_(engine),
+        id_(0),
+        startup_script_(false),
+        dedicated_(true),
+        parent_(nullptr),
+        isolate_(v8::Isolate::New()),
+        thread_manager_(nullptr),
+        tpl_cache_(nullptr) {
+    RT_ASSERT(engine_);
+    RT_ASSERT(isolate_);
+
+    isolate_->SetData(0, this);
+}
+
+/**
+ * Bind dedicated isolate to engine isolate which schedules
+ * its thread
+ */
+void Isolate::AttachTo(Isolate* parent) {
+    RT_ASSERT(dedicated_);
+    RT_ASSERT(parent);
+    RT_ASSERT(!parent->dedicated_);
+    RT_ASSERT(nullptr == parent_);
+    parent_ = parent;
+    id_ = parent->id_;
+    thread_manager_ = parent->thread_manager_;
+}
+
+void Isolate::DisposeUnattached() {
+    RT_ASSERT(dedicated_);
+    RT_ASSERT(nullptr == parent_);
+    RT_ASSERT(nullptr == tpl_cache_);
+    isolate_->Dispose();
+    delete this;
+}
+
 /**
  * Isolate initialization performed on idle thread stack. Startup
  * stack may be too small for v8 compiler.
@@ -63,7 +102,14 @@ void Isolate::NewThreads(SharedVector<ResourceHandle<EngineThread>> threads) {
     if (0 == threads.size()) return;
 
     for (ResourceHandle<EngineThread>& thread : threads) {
+        Isolate* isolate { thread.get()->isolate() };
+        RT_ASSERT(isolate);
+        if (isolate != this) {
+            isolate->AttachTo(this);
+        }
+
         thread.get()->thread_ = thread_manager_->CreateThread(
+            isolate,
             String(),
             thread);
     }
@@ -71,6 +117,11 @@ void Isolate::NewThreads(SharedVector<ResourceHandle<EngineThread>> threads) {
 
 
 void Isolate::ProcessNewThreads() {
+    if (nullptr != parent_) {
+        parent_->ProcessNewThreads();
+        return;
+    }
+
     NewThreads(std::move(engine_->threads().TakeNewThreads()));
 }
 
@@ -78,7 +129,34 @@ Thread* Isolate::current_thread() {
     return thread_manager_->current_thread();
 }
 
+void Isolate::SetTimer(ResourceHandle<EngineThread> thread,
+                       uint32_t timeout_id, uint64_t when_ticks) {
+    if (nullptr != parent_) {
+        parent_->SetTimer(thread, timeout_id, when_ticks);
+        return;
+    }
+
+    timers_.Set({thread, timeout_id}, when_ticks);
+}
+
+void Isolate::FireTimers() {
+    if (nullptr != parent_) {
+        parent_->FireTimers();
+        return;
+    }
+
+    uint64_t ticks_now { ticks_count() };
+    while (timers_.Elapsed(ticks_now)) {
+        EngineTimer timer { timers_.Take() };
+        std::unique_ptr<ThreadMessage> msg(new ThreadMessage(
+            ThreadMessage::Type::TIMEOUT_EVENT,
+            ResourceHandle<EngineThread>(), TransportData(), nullptr, timer.timeout_id));
+        timer.thread.get()->PushMessage(std::move(msg));
+    }
+}
+
 void Isolate::TimerInterruptNotify() {
+    RT_ASSERT(!dedicated_);
     ticks_counter_.AddFetch(1);
 }
 
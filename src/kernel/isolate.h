@@ -35,11 +35,25 @@ class Interface;
 class Engine;
 class EngineThread;
 
+/**
+ * One-shot timer armed by engine thread
+ */
+struct EngineTimer {
+    ResourceHandle<EngineThread> thread;
+    uint32_t timeout_id;
+};
 
 class Isolate {
 public:
     Isolate(Engine* engine, uint32_t id, bool first_isolate);
 
+    /**
+     * Create dedicated isolate for single thread. It has its own
+     * V8 heap and templates, but shares thread manager and ticks
+     * counter with engine isolate
+     */
+    explicit Isolate(Engine* engine);
+
     inline v8::Isolate* IsolateV8() const {
         return isolate_;
     }
@@ -55,29 +69,63 @@ public:
     void Init();
 
     uint64_t ticks_count() const {
+        if (nullptr != parent_) {
+            return parent_->ticks_count();
+        }
+
         return ticks_counter_.Get();
     }
 
+    /**
+     * True if this isolate runs single dedicated thread
+     */
+    bool is_dedicated() const {
+        return dedicated_;
+    }
+
     void ProcessNewThreads();
     void TimerInterruptNotify();
 
+    /**
+     * Arm timer in engine timer queue. Queue is accessed by
+     * engine CPU only, so arming doesn't lock
+     */
+    void SetTimer(ResourceHandle<EngineThread> thread,
+                  uint32_t timeout_id, uint64_t when_ticks);
+
+    /**
+     * Deliver expired timers to their threads, called on
+     * every thread switch
+     */
+    void FireTimers();
+
     Thread* current_thread();
     void Enter();
 
+    /**
+     * Release dedicated isolate which has never been given
+     * to a thread (process creation failed)
+     */
+    void DisposeUnattached();
+
     DELETE_COPY_AND_ASSIGN(Isolate);
 private:
 
     void NewThreads(SharedVector<ResourceHandle<EngineThread>> threads);
+    void AttachTo(Isolate* parent);
     ~Isolate() {}
 
     Engine* engine_;
     uint32_t id_;
     bool startup_script_;
+    bool dedicated_;
+    Isolate* parent_;
     v8::Isolate* isolate_;
     ThreadManager* thread_manager_;
     TemplateCache* tpl_cache_;
 
     Atomic<uint64_t> ticks_counter_;
+    Timeouts<EngineTimer> timers_;
 
     Locker thread_handles_locker_;
     Locker locker_;
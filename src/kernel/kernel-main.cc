@@ -16,6 +16,7 @@
 
 #include <libc.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <kernel/keystorage.h>
 #include <kernel/initrd.h>
@@ -73,6 +74,7 @@ void KernelMain::Initialize(void* mbt) {
     // Initialize memory manager for this CPU
     // After this line we can use malloc / free to allocate memory
     GLOBAL_mem_manager()->InitSubsystems();
+    GLOBAL_irqs()->InitCurrentCPU();
 
     CONSTRUCT_GLOBAL_OBJECT(GLOBAL_keystorage, KeyStorage, );           // NOLINT
     CONSTRUCT_GLOBAL_OBJECT(GLOBAL_initrd, Initrd, );                   // NOLINT
@@ -150,6 +152,14 @@ void KernelMain::InitSystemBSP(void* mbt) {
     printf("Found %d cpus.\n", cpus_found);
 
     const char* cmdline = parsed.cmdline();
+
+    // Maximum thread stack size in MiB
+    const char* stack_limit = strstr(cmdline, "stacklimit=");
+    if (nullptr != stack_limit) {
+        uint64_t mib = strtoul(stack_limit + strlen("stacklimit="), nullptr, 10);
+        GLOBAL_mem_manager()->virtual_allocator().set_stack_limit(mib * common::Constants::MiB);
+    }
+
     if (nullptr != strstr(cmdline, "test")) {
         GLOBAL_boot_services()->logger()->SetMode(LoggerMode::TEST);
         test::TestFramework tests;
@@ -176,7 +186,11 @@ void KernelMain::InitSystemBSP(void* mbt) {
 }
 
 void KernelMain::InitSystemAP() {
+    // Page faults are handled on exception stack, AP should load
+    // its TSS before anything outside of identity mapped region
+    // is touched
     GLOBAL_mem_manager()->InitSubsystems();
+    GLOBAL_irqs()->InitCurrentCPU();
     GLOBAL_platform()->InitCurrentCPU();
 }
 
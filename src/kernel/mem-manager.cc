@@ -24,7 +24,14 @@ MemManager::MemManager()
         vmm_(),
         table_allocator_(pmm_, vmm_),
         addr_space_(&table_allocator_),
-        malloc_available_(false) {}
+        malloc_available_(false) {
+    memset(cpu_nodes_, 0, sizeof(cpu_nodes_));
+}
+
+uint32_t MemManager::current_node() const {
+    uint32_t cpu = Cpu::id();
+    return cpu < kMaxCpus ? cpu_nodes_[cpu] : 0;
+}
 
 void MemManager::InitSubsystems() {
     if (0 == Cpu::id()) {
@@ -55,9 +62,18 @@ void MemManager::PageFault(void* fault_address, uint64_t error_code) {
         // Lazy-identity mapping for 4 GB virtual address space
         phys_mem = fault_address;
         writethrough = true;
+    } else if (VirtualAllocator::IsStackAddress(fa) && !vmm_.IsStackCommitAllowed(fa)) {
+        GLOBAL_boot_services()
+            ->FatalError("Thread stack overflow, address = %p,"
+                         " error code = %d, cpu %d\n",
+                         fault_address, error_code, Cpu::id());
     } else if (fa < 512 * 256 * common::Constants::GiB) {
-        // Automatic mapping normal space
-        phys_mem = pmm_.alloc();
+        // Automatic mapping normal space, thread stacks are
+        // committed here too. Prefer memory local to faulting CPU
+        phys_mem = pmm_.alloc(current_node());
+        if (VirtualAllocator::IsStackAddress(fa)) {
+            vmm_.StackPageCommitted();
+        }
 
         // clean = true;
         writethrough = false;
@@ -77,6 +93,116 @@ void MemManager::PageFault(void* fault_address, uint64_t error_code) {
     }
 }
 
+void PhysicalAllocator::SetNumaLayout(const NumaMemoryRange* ranges, uint32_t ranges_count,
+                                      uint32_t nodes_count, const uint8_t* distances) {
+    RT_ASSERT(ranges);
+    RT_ASSERT(distances);
+    RT_ASSERT(1 == nodes_count_);
+    if (nodes_count < 2) {
+        return;
+    }
+
+    RT_ASSERT(nodes_count <= kMaxNodes);
+    if (ranges_count > kMaxRanges) {
+        ranges_count = kMaxRanges;
+    }
+
+    Node nodes[kMaxNodes];
+    uint64_t capacity[kMaxNodes];
+    for (uint32_t i = 0; i < nodes_count; ++i) {
+        capacity[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < ranges_count; ++i) {
+        RT_ASSERT(ranges[i].node < nodes_count);
+        ranges_[i] = ranges[i];
+        capacity[ranges[i].node] += ranges[i].length / kPageSizeBytes + 1;
+    }
+    ranges_count_ = ranges_count;
+
+    // Memory not covered by any range belongs to first node
+    capacity[0] += available_phys_memory_ / kPageSizeBytes;
+
+    // Pages are counted for the node their first byte belongs to
+    for (uint32_t i = 0; i < zones_.count(); ++i) {
+        const PagesZone& zone = zones_.get(i);
+        uint64_t first = zone.first_page;
+        while (first < zone.last_page) {
+            uint64_t end = NodeRunEnd(first, zone.last_page);
+            nodes[NodeOfPage(first)].total_pages += end - first;
+            first = end;
+        }
+    }
+
+    // Stack storage is zeroed to fault it in now, page faults
+    // while pages are moved would pop from old stacks
+    for (uint32_t i = 0; i < nodes_count; ++i) {
+        size_t size = (capacity[i] + 2) * sizeof(uint64_t);
+        nodes[i].stack_32 = new PagesStack(
+            reinterpret_cast<uintptr_t>(new uint64_t[capacity[i] + 2]()), size);
+        nodes[i].stack_64 = new PagesStack(
+            reinterpret_cast<uintptr_t>(new uint64_t[capacity[i] + 2]()), size);
+    }
+
+    // Extents are split into runs of pages of the same node
+    PagesExtents* old_extents[] = { &nodes_[0].extents_32, &nodes_[0].extents_64 };
+    for (PagesExtents* extents : old_extents) {
+        uint64_t first = 0;
+        uint64_t last = 0;
+        while (extents->pop_extent(&first, &last)) {
+            while (first < last) {
+                uint64_t end = NodeRunEnd(first, last);
+                AddFreePages(&nodes[NodeOfPage(first)], first, end);
+                first = end;
+            }
+        }
+    }
+
+    uint64_t last_32bit = 0xffffffff / kPageSizeBytes;
+    PagesStack* old_stacks[] = { &stack_32_, &stack_64_ };
+    for (PagesStack* stack : old_stacks) {
+        for (uint64_t page = stack->pop(); 0 != page; page = stack->pop()) {
+            Node& node = nodes[NodeOfPage(page)];
+            ++node.free_pages;
+            if (page <= last_32bit) {
+                node.stack_32->push(page);
+            } else {
+                node.stack_64->push(page);
+            }
+        }
+    }
+
+    // Fallback order is the row of distance matrix sorted
+    // by distance, insertion sort keeps node order for ties
+    for (uint32_t i = 0; i < nodes_count; ++i) {
+        const uint8_t* row = distances + i * nodes_count;
+        uint32_t* order = nodes[i].fallback;
+        order[0] = i;
+        uint32_t count = 1;
+        for (uint32_t j = 0; j < nodes_count; ++j) {
+            if (j == i) {
+                continue;
+            }
+
+            uint32_t pos = count++;
+            while (pos > 1 && row[order[pos - 1]] > row[j]) {
+                order[pos] = order[pos - 1];
+                --pos;
+            }
+            order[pos] = j;
+        }
+    }
+
+    for (uint32_t i = 0; i < nodes_count; ++i) {
+        nodes_[i] = nodes[i];
+        printf("NUMA node %d: %d MiB, %d MiB free\n", i,
+               nodes[i].total_pages * kPageSizeBytes / common::Constants::MiB,
+               nodes[i].free_pages * kPageSizeBytes / common::Constants::MiB);
+    }
+
+    nodes_count_ = nodes_count;
+}
+
 MallocAllocator::MallocAllocator()
     :	default_mspace_(nullptr) {}
 
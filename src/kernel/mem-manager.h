@@ -16,6 +16,7 @@
 
 #include <kernel/kernel.h>
 #include <kernel/spinlock.h>
+#include <kernel/atomic.h>
 #include <kernel/multiboot.h>
 #include <kernel/boot-services.h>
 #include <kernel/dlmalloc.h>
@@ -57,6 +58,177 @@ private:
     uint64_t* current_location_;
 };
 
+/**
+ * Free physical pages stored as ranges. Memory map entries are
+ * added as a whole, so initialization doesn't depend on amount
+ * of memory
+ */
+class PagesExtents {
+public:
+    PagesExtents()
+        :	count_(0),
+            pages_count_(0) {}
+
+    static const uint32_t kMaxExtents = 32;
+
+    /**
+     * Add pages [first, last), returns false if there is no
+     * free slot for the extent
+     */
+    bool push(uint64_t first, uint64_t last) {
+        if (first >= last) {
+            return true;
+        }
+
+        if (count_ >= kMaxExtents) {
+            return false;
+        }
+
+        extents_[count_++] = { first, last };
+        pages_count_ += last - first;
+        return true;
+    }
+
+    /**
+     * Take page from the end of last extent, returns
+     * 0 if there are no pages left
+     */
+    inline uint64_t pop() {
+        if (0 == count_) {
+            return 0;
+        }
+
+        Extent& extent = extents_[count_ - 1];
+        uint64_t pageid = --extent.last;
+        if (extent.first == extent.last) {
+            --count_;
+        }
+
+        --pages_count_;
+        return pageid;
+    }
+
+    /**
+     * Remove whole last extent
+     */
+    bool pop_extent(uint64_t* first, uint64_t* last) {
+        RT_ASSERT(first);
+        RT_ASSERT(last);
+        if (0 == count_) {
+            return false;
+        }
+
+        Extent& extent = extents_[--count_];
+        *first = extent.first;
+        *last = extent.last;
+        pages_count_ -= extent.last - extent.first;
+        return true;
+    }
+
+    uint64_t pages_count() const { return pages_count_; }
+
+private:
+    struct Extent {
+        uint64_t first;
+        uint64_t last;
+    };
+
+    Extent extents_[kMaxExtents];
+    uint32_t count_;
+    uint64_t pages_count_;
+};
+
+/**
+ * Range of physical pages [first_page, last_page)
+ */
+struct PagesZone {
+    uint64_t first_page;
+    uint64_t last_page;
+};
+
+/**
+ * Non-overlapping page ranges taken from boot memory map.
+ * Memory map entries can overlap, only pages not covered by
+ * earlier entries are inserted
+ */
+class PagesZones {
+public:
+    PagesZones()
+        :	count_(0) {}
+
+    static const uint32_t kMaxZones = 32;
+
+    /**
+     * Subtract existing zones from pages [first, last) and add
+     * remaining pieces as new zones. Pieces are written to
+     * pieces array (kMaxZones + 1 entries), returns pieces count.
+     * Pieces which don't fit into zones table are dropped
+     */
+    uint32_t Insert(uint64_t first, uint64_t last, PagesZone* pieces) {
+        RT_ASSERT(pieces);
+        uint32_t pieces_count = 0;
+        if (first < last) {
+            pieces[pieces_count++] = { first, last };
+        }
+
+        // Zones are disjoint, so each one splits at most one
+        // piece and there are never more than count_ + 1 pieces
+        for (uint32_t i = 0; i < count_; ++i) {
+            const PagesZone& zone = zones_[i];
+            uint32_t n = pieces_count;
+            for (uint32_t j = 0; j < n; ++j) {
+                PagesZone& piece = pieces[j];
+                if (piece.last_page <= zone.first_page
+                    || piece.first_page >= zone.last_page) {
+                    continue;
+                }
+
+                if (piece.last_page > zone.last_page) {
+                    if (piece.first_page < zone.first_page) {
+                        RT_ASSERT(pieces_count <= kMaxZones);
+                        pieces[pieces_count++] = { zone.last_page, piece.last_page };
+                        piece.last_page = zone.first_page;
+                    } else {
+                        piece.first_page = zone.last_page;
+                    }
+                } else {
+                    piece.last_page = piece.first_page < zone.first_page
+                        ? zone.first_page : piece.first_page;
+                }
+            }
+        }
+
+        uint32_t result = 0;
+        for (uint32_t j = 0; j < pieces_count; ++j) {
+            if (pieces[j].first_page >= pieces[j].last_page) {
+                continue;
+            }
+
+            if (count_ >= kMaxZones) {
+                printf("Too many memory zones, range %d MB - %d MB ignored.\n",
+                       pieces[j].first_page * 2, pieces[j].last_page * 2);
+                continue;
+            }
+
+            zones_[count_++] = pieces[j];
+            pieces[result++] = pieces[j];
+        }
+
+        return result;
+    }
+
+    uint32_t count() const { return count_; }
+
+    const PagesZone& get(uint32_t index) const {
+        RT_ASSERT(index < count_);
+        return zones_[index];
+    }
+
+private:
+    PagesZone zones_[kMaxZones];
+    uint32_t count_;
+};
+
 /**
  * Represents chunk of physical memory
  */
@@ -83,6 +255,27 @@ private:
     size_t size_;
 };
 
+/**
+ * Physical memory range local to NUMA node
+ */
+struct NumaMemoryRange {
+    uint64_t base;
+    uint64_t length;
+    uint32_t node;
+};
+
+/**
+ * Physical memory usage of NUMA node. Allocations are counted
+ * for requesting node, remote means page was taken from
+ * another node
+ */
+struct NumaNodeStats {
+    uint64_t total_bytes;
+    uint64_t free_bytes;
+    uint64_t local_allocs;
+    uint64_t remote_allocs;
+};
+
 /**
  * Manages physical pages of memory
  *
@@ -104,13 +297,24 @@ private:
  */
 class PhysicalAllocator {
 public:
+    static const uint32_t kMaxNodes = 8;
+    static const uint32_t kMaxRanges = 32;
+
     PhysicalAllocator() :
         stack_32_(kStackStartAddress, 1 * common::Constants::MiB),
         stack_64_(kStackStartAddress + common::Constants::MiB, 1 * common::Constants::MiB),
         pages_status_(reinterpret_cast<bool*>(kPagesStatusStartAddress)),
-        available_phys_memory_(0) {
+        available_phys_memory_(0),
+        nodes_count_(1),
+        ranges_count_(0) {
+
+        // Single node owns all memory until NUMA layout is known
+        nodes_[0].stack_32 = &stack_32_;
+        nodes_[0].stack_64 = &stack_64_;
 
-        memset(reinterpret_cast<void*>(kPagesStatusStartAddress), 1, kPagesStatusSize);
+        // Status is only written when page is allocated or freed,
+        // free pages are tracked by extents
+        memset(reinterpret_cast<void*>(kPagesStatusStartAddress), 0, kPagesStatusSize);
         MultibootMemoryMapEnumerator mmap = GLOBAL_multiboot()->memory_map();
 
         do {
@@ -161,11 +365,16 @@ public:
         }
         pages_status_[pageid] = false;
 
+        // Node is unknown while NUMA layout is being set up
+        uint32_t index = NodeOfPage(pageid);
+        Node& node = nodes_[index < nodes_count_ ? index : 0];
+        ++node.free_pages;
+
         uint64_t last_32bit = 0xffffffff / kPageSizeBytes;
         if (pageid <= last_32bit) {
-            stack_32_.push(pageid);
+            node.stack_32->push(pageid);
         } else {
-            stack_64_.push(pageid);
+            node.stack_64->push(pageid);
         }
     }
 
@@ -179,32 +388,50 @@ public:
                                   kAllocStartAddress - kPageDirectoryStart);
     }
 
-    inline void* alloc32() {
-        uint64_t pageid = stack_32_.pop();
+    /**
+     * Allocate page below 4 GiB, preferably on given node
+     */
+    inline void* alloc32(uint32_t node = 0) {
+        uint64_t pageid = PopPage(node, true);
         if (0 == pageid) {
             RT_ASSERT(!"No more physical pages to allocate (32 bit).");
             return nullptr;
         }
 
-        pages_status_[pageid] = true;
         return reinterpret_cast<void*>(pageid * kPageSizeBytes);
     }
 
-    inline void* alloc() {
-        uint64_t pageid = stack_64_.pop();
-        if (0 == pageid) {
-            pageid = stack_32_.pop();
-        }
-
+    /**
+     * Allocate page, preferably on given node. Nodes are tried
+     * in order of distance when it runs out of memory
+     */
+    inline void* alloc(uint32_t node = 0) {
+        uint64_t pageid = PopPage(node, false);
         if (0 == pageid) {
             RT_ASSERT(!"No more physical pages to allocate.");
             return nullptr;
         }
 
-        pages_status_[pageid] = true;
         return reinterpret_cast<void*>(pageid * kPageSizeBytes);
     }
 
+    /**
+     * Split free pages into per-node free lists. Distances is
+     * nodes_count * nodes_count matrix of relative access cost
+     * (SLIT format), malloc should be available
+     */
+    void SetNumaLayout(const NumaMemoryRange* ranges, uint32_t ranges_count,
+                       uint32_t nodes_count, const uint8_t* distances);
+
+    uint32_t nodes_count() const { return nodes_count_; }
+
+    NumaNodeStats node_stats(uint32_t node) const {
+        RT_ASSERT(node < nodes_count_);
+        const Node& n = nodes_[node];
+        return { n.total_pages * kPageSizeBytes, n.free_pages * kPageSizeBytes,
+                 n.local_allocs, n.remote_allocs };
+    }
+
     uint64_t physical_memory_total() const {
         return available_phys_memory_;
     }
@@ -229,39 +456,155 @@ private:
     static const uint64_t kPagesStatusStartAddress = 24 * common::Constants::MiB;
     static const uint64_t kPagesStatusSize = 2 * common::Constants::MiB;
 
+    struct Node {
+        Node()
+            :	stack_32(nullptr),
+                stack_64(nullptr),
+                total_pages(0),
+                free_pages(0),
+                local_allocs(0),
+                remote_allocs(0) {
+            memset(fallback, 0, sizeof(fallback));
+        }
+
+        PagesStack* stack_32;           // Freed pages
+        PagesStack* stack_64;
+        PagesExtents extents_32;        // Never allocated pages
+        PagesExtents extents_64;
+        uint64_t total_pages;
+        uint64_t free_pages;
+        uint64_t local_allocs;
+        uint64_t remote_allocs;
+        uint32_t fallback[kMaxNodes];   // Nodes sorted by distance, self first
+    };
+
     PagesStack stack_32_;
     PagesStack stack_64_;
     bool* pages_status_;
     Locker alloc_locker_;
     uint64_t available_phys_memory_;
+    Node nodes_[kMaxNodes];
+    uint32_t nodes_count_;
+    NumaMemoryRange ranges_[kMaxRanges];
+    uint32_t ranges_count_;
+    PagesZones zones_;              // Usable memory from boot memory map
+
+    uint32_t NodeOfPage(uint64_t pageid) const {
+        uint64_t address = pageid * kPageSizeBytes;
+        for (uint32_t i = 0; i < ranges_count_; ++i) {
+            const NumaMemoryRange& range = ranges_[i];
+            if (address >= range.base && address - range.base < range.length) {
+                return range.node;
+            }
+        }
+        return 0;
+    }
 
-    void _insert_pages_range(uintptr_t start, uintptr_t end) {
-        uint64_t first_page = start / kPageSizeBytes;
-        uint64_t last_page = end / kPageSizeBytes;
+    uint64_t PopPage(uint32_t preferred, bool only_32bit) {
+        if (preferred >= nodes_count_) {
+            preferred = 0;
+        }
 
-        uint64_t last_32bit = 0xffffffff / kPageSizeBytes;
+        Node& home = nodes_[preferred];
+        for (uint32_t i = 0; i < nodes_count_; ++i) {
+            Node& node = nodes_[home.fallback[i]];
+            uint64_t pageid = 0;
+            if (!only_32bit) {
+                pageid = node.stack_64->pop();
+                if (0 == pageid) {
+                    pageid = node.extents_64.pop();
+                }
+            }
 
-        if (first_page >= last_page) {
-            return;
-        }
+            if (0 == pageid) {
+                pageid = node.stack_32->pop();
+            }
 
-        for (uint64_t i = first_page; i < last_page; ++i) {
-            if (0 ==pages_status_[i]) {
-                // Skip double insert
-                continue;
+            if (0 == pageid) {
+                pageid = node.extents_32.pop();
             }
 
-            pages_status_[i] = false;
+            if (0 == pageid) {
+                continue;
+            }
 
-            if (i <= last_32bit) {
-                stack_32_.push(i);
+            --node.free_pages;
+            if (&node == &home) {
+                ++home.local_allocs;
             } else {
-                stack_64_.push(i);
+                ++home.remote_allocs;
+            }
+
+            pages_status_[pageid] = true;
+            return pageid;
+        }
+
+        return 0;
+    }
+
+    /**
+     * Page index after the last one with the same node as
+     * first page, but not above last
+     */
+    uint64_t NodeRunEnd(uint64_t first, uint64_t last) const {
+        uint64_t end = last;
+        for (uint32_t i = 0; i < ranges_count_; ++i) {
+            const NumaMemoryRange& range = ranges_[i];
+            uint64_t bounds[] = {
+                (range.base + kPageSizeBytes - 1) / kPageSizeBytes,
+                (range.base + range.length + kPageSizeBytes - 1) / kPageSizeBytes
+            };
+
+            for (uint64_t bound : bounds) {
+                if (bound > first && bound < end) {
+                    end = bound;
+                }
+            }
+        }
+        return end;
+    }
+
+    /**
+     * Add free pages [first, last) to node, range is split
+     * at 4 GiB boundary
+     */
+    static void AddFreePages(Node* node, uint64_t first, uint64_t last) {
+        RT_ASSERT(node);
+        uint64_t first_64bit = 0x100000000ULL / kPageSizeBytes;
+        uint64_t split = first < first_64bit ? (last < first_64bit ? last : first_64bit) : first;
+
+        // Extent slots are exhausted only by very fragmented
+        // memory maps, keep remaining pages in stack
+        if (!node->extents_32.push(first, split)) {
+            for (uint64_t i = first; i < split; ++i) {
+                node->stack_32->push(i);
+            }
+        }
+
+        if (!node->extents_64.push(split, last)) {
+            for (uint64_t i = split; i < last; ++i) {
+                node->stack_64->push(i);
             }
+        }
 
-            available_phys_memory_ += chunk_size();
+        node->free_pages += last - first;
+    }
+
+    void _insert_pages_range(uintptr_t start, uintptr_t end) {
+        // Skip pages of overlapping memory map entries
+        // inserted earlier
+        PagesZone pieces[PagesZones::kMaxZones + 1];
+        uint32_t count = zones_.Insert(start / kPageSizeBytes,
+                                       end / kPageSizeBytes, pieces);
+
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t first_page = pieces[i].first_page;
+            uint64_t last_page = pieces[i].last_page;
+            AddFreePages(&nodes_[0], first_page, last_page);
+            available_phys_memory_ += (last_page - first_page) * kPageSizeBytes;
+            nodes_[0].total_pages += last_page - first_page;
+            printf("RANGE %d MB - %d MB \n", first_page * 2, (last_page-1) * 2);
         }
-        printf("RANGE %d MB - %d MB \n", first_page * 2, (last_page-1) * 2);
     }
 };
 
@@ -293,20 +636,105 @@ private:
 class VirtualAllocator {
 public:
     VirtualAllocator() :
-        stack_alloc_next_(kStacks) {}
+        stack_alloc_next_(kStacks),
+        stack_limit_(kDefaultStackLimit),
+        stacks_count_(0) {}
 
+    /**
+     * Reserve thread stack. Only reservation is made here, stack
+     * pages are committed on demand by page fault handler
+     * until stack reaches its limit. Each stack takes its limit
+     * plus one guard page of 128 GiB stacks region, so there
+     * is room for 13107 stacks with default 8 MiB limit
+     */
     VirtualStack AllocStack() {
         ScopedLock lock(stack_alloc_locker_);
-        void* top = reinterpret_cast<void*>(stack_alloc_next_);
         uint64_t page_size = PhysicalAllocator::chunk_size();
-        stack_alloc_next_ += 2 * page_size; // reserve two pages (1 extra for guard page)
 
-        // This is required to trigger PF
-        // Stack page needs to be allocated before
-        // thread can switch to it with IRETQ
-        memset(top, 0, page_size);
+        // Guard page is at the start of the slot, stack
+        // takes the rest of it
+        uint64_t slot_end = stack_alloc_next_ + page_size + stack_limit_;
+        if (slot_end > kStacks + kStacksSize || stacks_count_ >= kMaxStacks) {
+            GLOBAL_boot_services()->FatalError("Out of thread stacks space, %d stacks"
+                                               " of %d MiB allocated\n", stacks_count_,
+                                               stack_limit_ / common::Constants::MiB);
+        }
+
+        stack_alloc_next_ = slot_end;
+        stack_ends_[stacks_count_] = (slot_end - kStacks) / page_size;
+        ++stacks_count_;
 
-        return VirtualStack(top, page_size);
+        void* top = reinterpret_cast<void*>(slot_end - stack_limit_);
+        return VirtualStack(top, stack_limit_);
+    }
+
+    /**
+     * Set maximum size of stacks allocated after this call,
+     * rounded up to page size. Larger limit means fewer
+     * stacks fit into stacks region
+     */
+    void set_stack_limit(size_t limit) {
+        uint64_t page_size = PhysicalAllocator::chunk_size();
+        limit = (limit + page_size - 1) & ~(page_size - 1);
+        if (limit < page_size) {
+            limit = page_size;
+        }
+
+        if (limit > kMaxStackLimit) {
+            limit = kMaxStackLimit;
+        }
+
+        ScopedLock lock(stack_alloc_locker_);
+        stack_limit_ = limit;
+    }
+
+    size_t stack_limit() const { return stack_limit_; }
+
+    static bool IsStackAddress(uintptr_t address) {
+        return address >= kStacks && address < kStacks + kStacksSize;
+    }
+
+    /**
+     * Check if page fault address is within its stack limit,
+     * otherwise it's a stack overflow
+     */
+    bool IsStackCommitAllowed(uintptr_t address) const {
+        RT_ASSERT(IsStackAddress(address));
+        uint32_t page = (address - kStacks) / PhysicalAllocator::chunk_size();
+
+        // Slots are allocated in address order, find the
+        // first one ending above the page
+        uint32_t first = 0;
+        uint32_t last = stacks_count_;
+        while (first < last) {
+            uint32_t middle = first + (last - first) / 2;
+            if (stack_ends_[middle] <= page) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+
+        if (first >= stacks_count_) {
+            return false;
+        }
+
+        // First page of the slot is the guard
+        uint32_t guard = (0 == first) ? 0 : stack_ends_[first - 1];
+        return page > guard;
+    }
+
+    /**
+     * Count committed stack page, used for memory usage stats
+     */
+    void StackPageCommitted() {
+        stack_pages_committed_.AddFetch(1);
+    }
+
+    uint32_t stacks_count() const { return stacks_count_; }
+
+    uint64_t stack_bytes_committed() const {
+        return stack_pages_committed_.Get() * PhysicalAllocator::chunk_size();
     }
 
     void* GetCpuSpace() const {
@@ -328,9 +756,19 @@ public:
     static const uint64_t kSpacesBase = 256 * common::Constants::GiB;
     static const uint64_t kSpaceSize = 256 * common::Constants::GiB;
     static const uint64_t kStacks = 128 * common::Constants::GiB;
+    static const uint64_t kStacksSize = 128 * common::Constants::GiB;
+    static const uint64_t kDefaultStackLimit = 8 * common::Constants::MiB;
+    static const uint64_t kMaxStackLimit = 256 * common::Constants::MiB;
 private:
+    // Smallest slot is one stack page and one guard page
+    static const uint32_t kMaxStacks = kStacksSize / (4 * common::Constants::MiB);
+
     Locker stack_alloc_locker_;
     uint64_t stack_alloc_next_;
+    size_t stack_limit_;
+    uint32_t stacks_count_;
+    uint32_t stack_ends_[kMaxStacks];   // Slot end page relative to stacks region
+    Atomic<uint64_t> stack_pages_committed_;
     DELETE_COPY_AND_ASSIGN(VirtualAllocator);
 };
 
@@ -450,7 +888,19 @@ public:
      */
     void* AllocPage32() {
         ScopedLock lock(page_alloc_locker_);
-        return pmm_.alloc32();
+        return pmm_.alloc32(current_node());
+    }
+
+    /**
+     * Get physical address of memory at virtual address, maps
+     * page if required. Page is marked pinned, remapping it to
+     * another physical address asserts, so address stays valid
+     * while memory is not freed
+     */
+    void* PinPage(void* virtaddr) {
+        // Touch page to trigger PF if it's not mapped yet
+        *reinterpret_cast<volatile uint8_t*>(virtaddr);
+        return addr_space_.PinPage(virtaddr);
     }
 
     /**
@@ -468,6 +918,39 @@ public:
         return pmm_.physical_memory_total();
     }
 
+    /**
+     * Split physical memory into NUMA nodes, called once ACPI
+     * tables are parsed
+     */
+    void SetNumaLayout(const NumaMemoryRange* ranges, uint32_t ranges_count,
+                       uint32_t nodes_count, const uint8_t* distances) {
+        ScopedLock lock(page_alloc_locker_);
+        pmm_.SetNumaLayout(ranges, ranges_count, nodes_count, distances);
+    }
+
+    /**
+     * Set NUMA node local to CPU, page faults on this CPU
+     * will prefer memory of the node
+     */
+    void SetCpuNode(uint32_t cpu, uint32_t node) {
+        if (cpu < kMaxCpus) {
+            cpu_nodes_[cpu] = node;
+        }
+    }
+
+    /**
+     * Get NUMA node of current CPU
+     */
+    uint32_t current_node() const;
+
+    uint32_t numa_nodes_count() const {
+        return pmm_.nodes_count();
+    }
+
+    NumaNodeStats numa_node_stats(uint32_t node) const {
+        return pmm_.node_stats(node);
+    }
+
     inline VirtualAllocator& virtual_allocator() { return vmm_; }
     inline MallocAllocator& malloc_allocator() { return malloc_; }
     inline AddressSpaceX64& address_space() { return addr_space_; }
@@ -479,6 +962,8 @@ private:
     AddressSpaceX64 addr_space_;
     bool malloc_available_;
     Locker page_alloc_locker_;
+    static const uint32_t kMaxCpus = 256;
+    uint8_t cpu_nodes_[kMaxCpus];
     DELETE_COPY_AND_ASSIGN(MemManager);
 };
 
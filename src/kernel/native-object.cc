@@ -28,9 +28,6 @@ namespace rt {
 
 using ::common::Nullable;
 
-template<typename T>
-using SharedSTLVector = std::vector<T, DefaultSTLAlloc<T>>;
-
 NATIVE_FUNCTION(NativesObject, CallHandler) {
     PROLOGUE_NOTHIS;
 
@@ -76,60 +73,35 @@ NATIVE_FUNCTION(NativesObject, CallHandler) {
     args.GetReturnValue().Set(promise_resolver);
 }
 
-NATIVE_FUNCTION(NativesObject, CallResult) {
+NATIVE_FUNCTION(NativesObject, Timeout) {
     PROLOGUE_NOTHIS;
-    RT_ASSERT(4 == args.Length());
+    RT_ASSERT(2 == args.Length());
     USEARG(0);
     USEARG(1);
-    USEARG(2);
-    USEARG(3);
-    RT_ASSERT(arg0->IsBoolean());
-    RT_ASSERT(arg1->IsExternal());
-    RT_ASSERT(arg2->IsUint32());
+    RT_ASSERT(arg0->IsFunction());
+    RT_ASSERT(arg1->IsUint32());
 
     Thread* th = isolate->current_thread();
     RT_ASSERT(th);
 
-    v8::Local<v8::External> ext { v8::Local<v8::External>::Cast(arg1) };
-    void* val { ext->Value() };
-    RT_ASSERT(val);
-    ResourceHandle<EngineThread> thread(static_cast<EngineThread*>(val));
-
-    LockingPtr<EngineThread> lptr { thread.get() };
-    Isolate* isolate_recv { lptr->isolate() };
-    RT_ASSERT(isolate_recv);
-
-    TransportData data;
-    {	TransportData::SerializeError err { data.MoveValue(th, isolate_recv, arg3) };
-        if (TransportData::ThrowError(iv8, err)) return;
-    }
+    ResourceHandle<EngineThread> thread { th->handle() };
+    RT_ASSERT(!thread.empty());
 
-    {	std::unique_ptr<ThreadMessage> msg(new ThreadMessage(
-            arg0->BooleanValue() ?
-                ThreadMessage::Type::FUNCTION_RETURN_RESOLVE :
-                ThreadMessage::Type::FUNCTION_RETURN_REJECT,
-            th->handle(),
-            std::move(data), nullptr, arg2->Uint32Value()));
-        lptr->PushMessage(std::move(msg));
-    }
+    uint32_t index { th->AddTimeoutData(v8::UniquePersistent<v8::Value>(iv8, arg0)) };
+    th->SetTimeout(index, arg1->Uint32Value());
+    args.GetReturnValue().SetUndefined();
 }
 
-NATIVE_FUNCTION(NativesObject, Timeout) {
+NATIVE_FUNCTION(NativesObject, Yield) {
     PROLOGUE_NOTHIS;
-    RT_ASSERT(2 == args.Length());
+    RT_ASSERT(1 == args.Length());
     USEARG(0);
-    USEARG(1);
     RT_ASSERT(arg0->IsFunction());
-    RT_ASSERT(arg1->IsUint32());
 
     Thread* th = isolate->current_thread();
     RT_ASSERT(th);
 
-    ResourceHandle<EngineThread> thread { th->handle() };
-    RT_ASSERT(!thread.empty());
-
-    uint32_t index { th->AddTimeoutData(v8::UniquePersistent<v8::Value>(iv8, arg0)) };
-    th->SetTimeout(index, arg1->Uint32Value());
+    th->AddImmediate(arg0);
     args.GetReturnValue().SetUndefined();
 }
 
@@ -191,6 +163,50 @@ NATIVE_FUNCTION(NativesObject, InitrdList) {
     args.GetReturnValue().Set(arr);
 }
 
+NATIVE_FUNCTION(NativesObject, MemoryNodes) {
+    PROLOGUE_NOTHIS;
+    LOCAL_V8STRING(s_total, "total");
+    LOCAL_V8STRING(s_free, "free");
+    LOCAL_V8STRING(s_local_allocs, "localAllocs");
+    LOCAL_V8STRING(s_remote_allocs, "remoteAllocs");
+
+    uint32_t nodes_count = GLOBAL_mem_manager()->numa_nodes_count();
+    v8::Local<v8::Array> arr = v8::Array::New(iv8, nodes_count);
+
+    for (uint32_t i = 0; i < nodes_count; ++i) {
+        NumaNodeStats stats = GLOBAL_mem_manager()->numa_node_stats(i);
+        v8::Local<v8::Object> node = v8::Object::New(iv8);
+        node->Set(s_total, v8::Number::New(iv8, static_cast<double>(stats.total_bytes)));
+        node->Set(s_free, v8::Number::New(iv8, static_cast<double>(stats.free_bytes)));
+        node->Set(s_local_allocs, v8::Number::New(iv8, static_cast<double>(stats.local_allocs)));
+        node->Set(s_remote_allocs, v8::Number::New(iv8, static_cast<double>(stats.remote_allocs)));
+        arr->Set(i, node);
+    }
+
+    args.GetReturnValue().Set(arr);
+}
+
+NATIVE_FUNCTION(NativesObject, StackInfo) {
+    PROLOGUE_NOTHIS;
+    LOCAL_V8STRING(s_count, "count");
+    LOCAL_V8STRING(s_committed, "committed");
+    LOCAL_V8STRING(s_limit, "limit");
+
+    VirtualAllocator& vmm = GLOBAL_mem_manager()->virtual_allocator();
+    v8::Local<v8::Object> obj = v8::Object::New(iv8);
+    obj->Set(s_count, v8::Uint32::New(iv8, vmm.stacks_count()));
+    obj->Set(s_committed, v8::Number::New(iv8, static_cast<double>(vmm.stack_bytes_committed())));
+    obj->Set(s_limit, v8::Number::New(iv8, static_cast<double>(vmm.stack_limit())));
+    args.GetReturnValue().Set(obj);
+}
+
+NATIVE_FUNCTION(NativesObject, ClockNanoseconds) {
+    PROLOGUE_NOTHIS;
+    RT_ASSERT(GLOBAL_platform());
+    uint64_t ns = GLOBAL_platform()->clock_nanoseconds();
+    args.GetReturnValue().Set(v8::Number::New(iv8, static_cast<double>(ns)));
+}
+
 NATIVE_FUNCTION(NativesObject, KernelLoaderCallback) {
     PROLOGUE_NOTHIS;
     USEARG(0);
@@ -220,6 +236,7 @@ NATIVE_FUNCTION(NativesObject, Resources) {
     LOCAL_V8STRING(s_memory_range, "memoryRange");
     LOCAL_V8STRING(s_io_range, "ioRange");
     LOCAL_V8STRING(s_irq_range, "irqRange");
+    LOCAL_V8STRING(s_keyboard, "keyboard");
     LOCAL_V8STRING(s_process_manager, "processManager");
     LOCAL_V8STRING(s_acpi, "acpi");
     LOCAL_V8STRING(s_allocator, "allocator");
@@ -240,6 +257,8 @@ NATIVE_FUNCTION(NativesObject, Resources) {
     obj->Set(s_irq_range, (new ResourceIRQRangeObject(isolate, irq_range))
         ->GetInstance());
 
+    obj->Set(s_keyboard, (new ResourceKeyboardObject(isolate))->GetInstance());
+
     ResourceHandle<ProcessManager> proc_manager(&GLOBAL_engines()->process_manager());
     obj->Set(s_process_manager, (new ProcessManagerHandleObject(isolate, proc_manager))
         ->GetInstance());
@@ -265,24 +284,6 @@ NATIVE_FUNCTION(NativesObject, Args) {
     args.GetReturnValue().Set(threadargs);
 }
 
-NATIVE_FUNCTION(NativesObject, InstallInternals) {
-    PROLOGUE_NOTHIS;
-    USEARG(0);
-
-    Thread* th = isolate->current_thread();
-    RT_ASSERT(th);
-
-    RT_ASSERT(arg0->IsObject());
-    v8::Local<v8::Object> obj { arg0->ToObject() };
-    v8::Local<v8::String> call_wrapper_name { v8::String::NewFromUtf8(iv8, "callWrapper") };
-    RT_ASSERT(obj->HasOwnProperty(call_wrapper_name));
-    {	v8::Local<v8::Value> fnv { obj->Get(call_wrapper_name) };
-        RT_ASSERT(fnv->IsFunction());
-        v8::Local<v8::Function> fn { v8::Local<v8::Function>::Cast(fnv) };
-        th->SetCallWrapper(fn);
-    }
-}
-
 NATIVE_FUNCTION(NativesObject, Debug) {
     PROLOGUE_NOTHIS;
 
@@ -403,117 +404,14 @@ NATIVE_FUNCTION(AcpiHandleObject, HardwareId) {
         v8::String::kNormalString, len - 1));
 }
 
-class WalkResourcesIrqContext {
-public:
-    WalkResourcesIrqContext(AcpiPciIrqRoutingTable* routes,
-                            uint8_t device, uint8_t pin, uint8_t source_index)
-        :	_routes(routes),
-            _device(device),
-            _pin(pin),
-            _source_index(source_index) {
-        RT_ASSERT(_routes);
-    }
-    AcpiPciIrqRoutingTable* routes() const { return _routes; }
-    uint8_t device() const { return _device; }
-    uint8_t pin() const { return _pin; }
-    uint8_t source_index() const { return _source_index; }
-private:
-    AcpiPciIrqRoutingTable* _routes;
-    uint8_t _device;
-    uint8_t _pin;
-    uint8_t _source_index;
-};
-
-ACPI_STATUS WalkResourcesCallback(ACPI_RESOURCE *res, void *context) {
-    RT_ASSERT(res);
-    RT_ASSERT(context);
-    WalkResourcesIrqContext* ct = reinterpret_cast<WalkResourcesIrqContext*>(context);
-    RT_ASSERT(ct);
-    RT_ASSERT(ct->routes());
-
-    switch (res->Type) {
-    case ACPI_RESOURCE_TYPE_IRQ: {
-        ACPI_RESOURCE_IRQ* irq = &res->Data.Irq;
-        if (nullptr == irq || 0 == irq->InterruptCount) {
-            break;
-        }
-        RT_ASSERT(ct->source_index() < irq->InterruptCount);
-        ct->routes()->AddRoute(AcpiPciIrqRoute(ct->device(), ct->pin(),
-            irq->Interrupts[ct->source_index()]));
-    }
-        break;
-    case ACPI_RESOURCE_TYPE_EXTENDED_IRQ: {
-        ACPI_RESOURCE_EXTENDED_IRQ* irq = &res->Data.ExtendedIrq;
-        if (nullptr == irq || 0 == irq->InterruptCount) {
-            break;
-        }
-        RT_ASSERT(ct->source_index() < irq->InterruptCount);
-        ct->routes()->AddRoute(AcpiPciIrqRoute(ct->device(), ct->pin(),
-            irq->Interrupts[ct->source_index()]));
-    }
-        break;
-    default:
-        break;
-    }
-
-    return AE_OK;
-}
-
 NATIVE_FUNCTION(AcpiHandleObject, GetIrqRoutingTable) {
     PROLOGUE;
-    const size_t kBufSize = 8192;
-    std::array<char, kBufSize> databuf;
-    RT_ASSERT(databuf.data());
-    databuf.fill(0);
-
     RT_ASSERT(that->handle_);
-    ACPI_BUFFER buf;
-    buf.Length = kBufSize;
-    buf.Pointer = databuf.data();
-    ACPI_STATUS s = AcpiGetIrqRoutingTable(that->handle_, &buf);
-
-    if (ACPI_FAILURE(s)) {
-        printf("FAILLLL %s.\n", AcpiFormatException(s));
-        args.GetReturnValue().Set(v8::Array::New(iv8, 0));
-    }
-
-    RT_ASSERT(buf.Pointer);
-    RT_ASSERT(buf.Length > 0);
 
     AcpiPciIrqRoutingTable routes;
-
-    ACPI_PCI_ROUTING_TABLE* table = reinterpret_cast<ACPI_PCI_ROUTING_TABLE*>(buf.Pointer);
-    RT_ASSERT(table);
-    for (; table->Length; table =
-            reinterpret_cast<ACPI_PCI_ROUTING_TABLE*>(
-            reinterpret_cast<uint8_t*>(table) + table->Length)) {
-
-        RT_ASSERT(table);
-        uint8_t device_id = table->Address >> 16;
-        uint8_t func_id = table->Address & 0xFFFF;
-        uint8_t pin = table->Pin;
-        uint8_t source_index = table->SourceIndex;
-
-        char* src = reinterpret_cast<char*>(table->Source);
-        if ('\0' == src[0]) {
-            routes.AddRoute(AcpiPciIrqRoute(device_id, pin, source_index));
-            continue;
-        }
-
-        ACPI_HANDLE source;
-        s = AcpiGetHandle(that->handle_, table->Source, &source);
-        if (ACPI_FAILURE(s)) {
-            printf("Failed AcpiGetHandle %s\n", AcpiFormatException(s));
-            continue;
-        }
-
-        WalkResourcesIrqContext context(&routes, device_id, pin, source_index);
-        char crs[] = "_CRS";
-        s = AcpiWalkResources(source, crs, WalkResourcesCallback, &context);
-        if (ACPI_FAILURE(s)) {
-            printf("Failed IRQ resource\n");
-            continue;
-        }
+    if (!AcpiManager::GetIrqRoutingTable(that->handle_, 0, 0, &routes)) {
+        args.GetReturnValue().Set(v8::Array::New(iv8, 0));
+        return;
     }
 
     v8::Local<v8::String> str_device_id = v8::String::NewFromUtf8(iv8, "deviceId");
@@ -532,109 +430,122 @@ NATIVE_FUNCTION(AcpiHandleObject, GetIrqRoutingTable) {
     args.GetReturnValue().Set(arr);
 }
 
-ACPI_STATUS WalkResourcesBusLookupCallback(ACPI_RESOURCE *res, void* context) {
-    ACPI_RESOURCE_ADDRESS64 addr64;
-    int32_t* bus = reinterpret_cast<int32_t*>(context);
-
-    if ((res->Type != ACPI_RESOURCE_TYPE_ADDRESS16) &&
-        (res->Type != ACPI_RESOURCE_TYPE_ADDRESS32) &&
-        (res->Type != ACPI_RESOURCE_TYPE_ADDRESS64)) {
-        return AE_OK;
-    }
-
-    if (ACPI_FAILURE(AcpiResourceToAddress64(res, &addr64))) {
-        return AE_OK;
-    }
-
-    if (addr64.ResourceType != ACPI_BUS_NUMBER_RANGE) {
-        return AE_OK;
-    }
-
-    if (*bus != -1) {
-        return AE_ALREADY_EXISTS;
-    }
+NATIVE_FUNCTION(AcpiHandleObject, GetRootBridgeBusNumber) {
+    PROLOGUE;
 
-    if (addr64.Minimum > 0xFFFF) {
-        return AE_BAD_DATA;
+    int32_t bus { AcpiManager::GetRootBridgeBusNumber(that->handle_) };
+    if (bus < 0) {
+        args.GetReturnValue().SetNull();
+        return;
     }
 
-    *bus = (int32_t)addr64.Minimum;
-    return AE_OK;
+    args.GetReturnValue().Set(v8::Uint32::New(iv8, bus));
 }
 
-ACPI_STATUS EvalObjectTyped(ACPI_HANDLE handle, const char* pathname,
-        ACPI_OBJECT_LIST* external_params,
-        ACPI_BUFFER* return_buffer, ACPI_OBJECT_TYPE return_type) {
-
-    RT_ASSERT(4 == strnlen(pathname, 5));
-    char path[5];
-    strncpy(path, pathname, 4);
-    path[4] = '\0';
-    return AcpiEvaluateObjectTyped(handle, path, external_params, return_buffer, return_type);
+NATIVE_FUNCTION(AcpiManagerObject, SystemReset) {
+    PROLOGUE;
+    AcpiReset();
 }
 
-ACPI_STATUS EvalInteger(ACPI_HANDLE handle, const char* name, ACPI_INTEGER* ret) {
-    RT_ASSERT(ret != nullptr);
-    ACPI_STATUS as;
-    char intbuf[sizeof(ACPI_OBJECT)];
+NATIVE_FUNCTION(AcpiManagerObject, GetPciDevices) {
+    PROLOGUE;
 
-    ACPI_BUFFER intbufobj;
-    intbufobj.Length = sizeof(intbuf);
-    intbufobj.Pointer = intbuf;
+    AcpiObjectsList list = that->mgr_->GetPciDevices();
+    v8::Local<v8::Array> arr = v8::Array::New(iv8, list.size());
 
-    as = EvalObjectTyped(handle, name, NULL, &intbufobj, ACPI_TYPE_INTEGER);
-    if (ACPI_SUCCESS(as)) {
-        ACPI_OBJECT* obj = reinterpret_cast<ACPI_OBJECT*>(intbufobj.Pointer);
-        *ret = obj->Integer.Value;
+    for (size_t i = 0; i < list.size(); ++i) {
+        arr->Set(i, (new AcpiHandleObject(isolate, list.Get(i)))->GetInstance());
     }
 
-    return as;
-}
-
-ACPI_STATUS WalkResources(ACPI_HANDLE device_handle, const char* pathname,
-        ACPI_WALK_RESOURCE_CALLBACK user_function, void* context) {
-    RT_ASSERT(4 == strnlen(pathname, 5));
-    char path[5];
-    strncpy(path, pathname, 4);
-    path[4] = '\0';
-    return AcpiWalkResources(device_handle, path, user_function, context);
+    args.GetReturnValue().Set(arr);
 }
 
-NATIVE_FUNCTION(AcpiHandleObject, GetRootBridgeBusNumber) {
+NATIVE_FUNCTION(AcpiManagerObject, GetPciIrqRoutes) {
     PROLOGUE;
 
-    // Method1: Use _BBN on root bridge
-    ACPI_INTEGER busnum;
-    ACPI_STATUS as = EvalInteger(that->handle_, "_BBN", &busnum);
-    if (ACPI_SUCCESS(as)) {
-        args.GetReturnValue().Set(v8::Uint32::New(iv8, busnum & 0xFF));
-    }
+    AcpiPciIrqRoutingTable routes = that->mgr_->pci_irq_routes();
 
-    // Method2: Search for bus number in resources
-    int32_t invalid_bus = -1;
-    int32_t bus = invalid_bus;
-    ACPI_STATUS s = WalkResources(that->handle_, "_CRS", WalkResourcesBusLookupCallback, &bus);
-    if (ACPI_FAILURE(s) || invalid_bus == bus) {
-        args.GetReturnValue().SetNull();
-        return;
+    v8::Local<v8::String> str_segment = v8::String::NewFromUtf8(iv8, "segment");
+    v8::Local<v8::String> str_bus = v8::String::NewFromUtf8(iv8, "bus");
+    v8::Local<v8::String> str_device_id = v8::String::NewFromUtf8(iv8, "deviceId");
+    v8::Local<v8::String> str_irq = v8::String::NewFromUtf8(iv8, "irq");
+    v8::Local<v8::String> str_pin = v8::String::NewFromUtf8(iv8, "pin");
+
+    v8::Local<v8::Array> arr = v8::Array::New(iv8, routes.size());
+    for (size_t i = 0; i < routes.size(); ++i) {
+        AcpiPciIrqRoute route = routes.Get(i);
+        v8::Local<v8::Object> row = v8::Object::New(iv8);
+        row->Set(str_segment, v8::Uint32::New(iv8, route.segment()));
+        row->Set(str_bus, v8::Uint32::New(iv8, route.bus()));
+        row->Set(str_device_id, v8::Uint32::New(iv8, route.device()));
+        row->Set(str_irq, v8::Uint32::New(iv8, route.irq()));
+        row->Set(str_pin, v8::Uint32::New(iv8, route.pin()));
+        arr->Set(i, row);
     }
 
-    args.GetReturnValue().Set(v8::Uint32::New(iv8, s));
+    args.GetReturnValue().Set(arr);
 }
 
-NATIVE_FUNCTION(AcpiManagerObject, SystemReset) {
+NATIVE_FUNCTION(AcpiManagerObject, GetNamespace) {
     PROLOGUE;
-    AcpiReset();
-}
 
-NATIVE_FUNCTION(AcpiManagerObject, GetPciDevices) {
-    PROLOGUE;
+    AcpiNamespaceSnapshot nodes = that->mgr_->GetNamespaceSnapshot();
+
+    v8::Local<v8::String> str_name = v8::String::NewFromUtf8(iv8, "name");
+    v8::Local<v8::String> str_hid = v8::String::NewFromUtf8(iv8, "hid");
+    v8::Local<v8::String> str_parent = v8::String::NewFromUtf8(iv8, "parent");
+    v8::Local<v8::String> str_address = v8::String::NewFromUtf8(iv8, "address");
+    v8::Local<v8::String> str_root_bridge = v8::String::NewFromUtf8(iv8, "isRootBridge");
+    v8::Local<v8::String> str_bus = v8::String::NewFromUtf8(iv8, "bus");
+    v8::Local<v8::String> str_resources = v8::String::NewFromUtf8(iv8, "resources");
+    v8::Local<v8::String> str_type = v8::String::NewFromUtf8(iv8, "type");
+    v8::Local<v8::String> str_base = v8::String::NewFromUtf8(iv8, "base");
+    v8::Local<v8::String> str_length = v8::String::NewFromUtf8(iv8, "length");
+    v8::Local<v8::String> str_types[] = {
+        v8::String::NewFromUtf8(iv8, "irq"),
+        v8::String::NewFromUtf8(iv8, "io"),
+        v8::String::NewFromUtf8(iv8, "memory"),
+        v8::String::NewFromUtf8(iv8, "bus"),
+    };
+
+    v8::Local<v8::Array> arr = v8::Array::New(iv8, nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const AcpiNamespaceNode& node = nodes[i];
+        v8::Local<v8::Object> row = v8::Object::New(iv8);
+        row->Set(str_name, v8::String::NewFromUtf8(iv8, node.name()));
+        row->Set(str_hid, v8::String::NewFromUtf8(iv8, node.hid()));
 
-    AcpiObjectsList list = that->mgr_->GetPciDevices();
-    v8::Local<v8::Array> arr = v8::Array::New(iv8, list.size());
+        if (node.parent() < 0) {
+            row->Set(str_parent, v8::Null(iv8));
+        } else {
+            row->Set(str_parent, v8::Uint32::New(iv8, node.parent()));
+        }
 
-    for (size_t i = 0; i < list.size(); ++i) {
-        arr->Set(i, (new AcpiHandleObject(isolate, list.Get(i)))->GetInstance());
+        if (node.has_address()) {
+            row->Set(str_address, v8::Uint32::New(iv8, node.address()));
+        } else {
+            row->Set(str_address, v8::Null(iv8));
+        }
+
+        row->Set(str_root_bridge, v8::Boolean::New(iv8, node.root_bridge()));
+        if (node.bus() < 0) {
+            row->Set(str_bus, v8::Null(iv8));
+        } else {
+            row->Set(str_bus, v8::Uint32::New(iv8, node.bus()));
+        }
+
+        const std::vector<AcpiDeviceResource>& resources = node.resources();
+        v8::Local<v8::Array> res_arr = v8::Array::New(iv8, resources.size());
+        for (size_t j = 0; j < resources.size(); ++j) {
+            v8::Local<v8::Object> res = v8::Object::New(iv8);
+            res->Set(str_type, str_types[static_cast<int>(resources[j].type())]);
+            res->Set(str_base, v8::Number::New(iv8, resources[j].base()));
+            res->Set(str_length, v8::Number::New(iv8, resources[j].length()));
+            res_arr->Set(j, res);
+        }
+
+        row->Set(str_resources, res_arr);
+        arr->Set(i, row);
     }
 
     args.GetReturnValue().Set(arr);
@@ -787,6 +698,30 @@ NATIVE_FUNCTION(ResourceIRQObject, On) {
     args.GetReturnValue().SetUndefined();
 }
 
+NATIVE_FUNCTION(ResourceKeyboardObject, OnScancodes) {
+    PROLOGUE;
+    USEARG(0);
+    VALIDATEARG(0, FUNCTION, "onScancodes: argument 0 should be a function");
+
+    Thread* th = isolate->current_thread();
+    RT_ASSERT(th);
+    ResourceHandle<EngineThread> thread { th->handle() };
+    RT_ASSERT(!thread.empty());
+
+    uint8_t irq_number = GLOBAL_platform()->keyboard_irq();
+
+    // Second data source would steal bytes from the first one
+    uint32_t index { th->AddIRQData(v8::UniquePersistent<v8::Value>(iv8, arg0)) };
+    if (!GLOBAL_platform()->irq_dispatcher().BindDataSource(irq_number, thread, index,
+            GLOBAL_platform()->CreateKeyboardDataSource())) {
+        th->TakeIRQData(index);
+        THROW_ERROR("onScancodes: keyboard handler is already bound");
+    }
+
+    printf("[IRQ MANAGER] Bind scancodes %d (recv %d)\n", irq_number, index);
+    args.GetReturnValue().SetUndefined();
+}
+
 NATIVE_FUNCTION(ResourceMemoryBlockObject, DBG) {
     PROLOGUE;
 
@@ -836,26 +771,44 @@ NATIVE_FUNCTION(ProcessManagerHandleObject, Create) {
     RT_ASSERT(arg0->IsString());
     RT_ASSERT(arg1->IsObject());
 
+    // Optional process options object
+    bool dedicated_isolate = false;
+    if (args.Length() > 2 && args[2]->IsObject()) {
+        LOCAL_V8STRING(s_isolate, "isolate");
+        dedicated_isolate = args[2]->ToObject()->Get(s_isolate)->BooleanValue();
+    }
+
     RT_ASSERT(GLOBAL_engines()->execution_engines_count() > 0);
-    Engine* first_engine = GLOBAL_engines()->execution_engine(0);
-    RT_ASSERT(first_engine);
-    RT_ASSERT(first_engine->isolate());
+    Engine* engine = GLOBAL_engines()->PlaceProcess();
+    RT_ASSERT(engine);
 
     Thread* th = isolate->current_thread();
     RT_ASSERT(th);
 
+    // Thread is created only after data is serialized, so failed
+    // call doesn't leave empty thread (and its isolate) behind
+    Isolate* dedicated { dedicated_isolate ? engine->threads().NewDedicatedIsolate() : nullptr };
+    Isolate* isolate_recv { nullptr != dedicated ? dedicated : engine->isolate() };
+    RT_ASSERT(isolate_recv);
+
     TransportData td_code;
-    {	TransportData::SerializeError err { td_code.MoveValue(th, first_engine->isolate(), arg0) };
-        if (TransportData::ThrowError(iv8, err)) return;
+    TransportData td_args;
+    TransportData::SerializeError err { td_code.MoveValue(th, isolate_recv, arg0) };
+    if (TransportData::SerializeError::NONE == err) {
+        err = td_args.MoveValue(th, isolate_recv, arg1);
     }
 
-    TransportData td_args;
-    {	TransportData::SerializeError err { td_args.MoveValue(th, first_engine->isolate(), arg1) };
-        if (TransportData::ThrowError(iv8, err)) return;
+    if (TransportData::SerializeError::NONE != err) {
+        if (nullptr != dedicated) {
+            dedicated->DisposeUnattached();
+        }
+        TransportData::ThrowError(iv8, err);
+        return;
     }
 
+    ResourceHandle<EngineThread> st = engine->threads().Create(dedicated);
+    engine->AddProcess();
     ResourceHandle<Process> p = that->proc_mgr_.get()->CreateProcess();
-    ResourceHandle<EngineThread> st = first_engine->threads().Create();
 
     {	LockingPtr<EngineThread> thread { st.get() };
 
@@ -902,10 +855,171 @@ NATIVE_FUNCTION(AllocatorObject, AllocDMA) {
     v8::Local<v8::Object> ret { v8::Object::New(iv8) };
     ret->Set(s_address, v8::Uint32::New(iv8, static_cast<uint32_t>(ptrvalue)));
     ret->Set(s_size, v8::Uint32::New(iv8, static_cast<uint32_t>(size)));
-    ret->Set(s_buffer, v8::ArrayBuffer::New(iv8, ptr, size));
+    v8::Local<v8::ArrayBuffer> buffer { v8::ArrayBuffer::New(iv8, ptr, size) };
+    ArrayBufferPin::Attach(iv8, buffer, ptr, size, false);
+    ret->Set(s_buffer, buffer);
 
     args.GetReturnValue().Set(ret);
 }
 
+NATIVE_FUNCTION(AllocatorObject, PinDMA) {
+    PROLOGUE;
+    USEARG(0);
+    VALIDATEARG(0, ARRAYBUFFER, "pinDMA: argument 0 is not an ArrayBuffer");
+
+    // Optional mapping options object
+    bool dma32 = false;
+    if (args.Length() > 1 && args[1]->IsObject()) {
+        LOCAL_V8STRING(s_dma32, "dma32");
+        dma32 = args[1]->ToObject()->Get(s_dma32)->BooleanValue();
+    }
+
+    ArrayBufferPin* pin { ArrayBufferPin::FromBuffer(iv8,
+        v8::Local<v8::ArrayBuffer>::Cast(arg0)) };
+    if (nullptr == pin) {
+        THROW_ERROR("pinDMA: unable to pin buffer externalized outside of kernel");
+    }
+
+    if (dma32 && !DMAMappingObject::IsBelow4GiB(pin)) {
+        THROW_ERROR("pinDMA: buffer is not below 4 GiB");
+    }
+
+    args.GetReturnValue().Set((new DMAMappingObject(isolate, pin))->GetInstance());
+}
+
+ArrayBufferPin* ArrayBufferPin::Find(v8::Isolate* iv8,
+                                     v8::Local<v8::ArrayBuffer> buffer) {
+    LOCAL_V8STRING(s_pin, "rt::ArrayBufferPin");
+
+    v8::Local<v8::Value> ext { buffer->GetHiddenValue(s_pin) };
+    if (!ext.IsEmpty() && ext->IsExternal()) {
+        return static_cast<ArrayBufferPin*>(v8::Local<v8::External>::Cast(ext)->Value());
+    }
+
+    return nullptr;
+}
+
+ArrayBufferPin* ArrayBufferPin::FromBuffer(v8::Isolate* iv8,
+                                           v8::Local<v8::ArrayBuffer> buffer) {
+    ArrayBufferPin* existing { Find(iv8, buffer) };
+    if (nullptr != existing) {
+        return existing;
+    }
+
+    if (buffer->IsExternal()) {
+        return nullptr;
+    }
+
+    v8::ArrayBuffer::Contents c { buffer->Externalize() };
+    return Attach(iv8, buffer, c.Data(), c.ByteLength(), true);
+}
+
+ArrayBufferPin* ArrayBufferPin::Attach(v8::Isolate* iv8, v8::Local<v8::ArrayBuffer> buffer,
+                                       void* data, size_t length, bool owns_contents) {
+    LOCAL_V8STRING(s_pin, "rt::ArrayBufferPin");
+
+    ArrayBufferPin* pin { new ArrayBufferPin(iv8, buffer, data, length, owns_contents) };
+    buffer->SetHiddenValue(s_pin, v8::External::New(iv8, pin));
+    return pin;
+}
+
+ArrayBufferPin::~ArrayBufferPin() {
+    RT_ASSERT(0 == pin_count_);
+    if (owns_contents_ && nullptr != data_) {
+        RT_ASSERT(GLOBAL_engines());
+        GLOBAL_engines()->array_buffer_allocator()->Free(data_, length_);
+    }
+}
+
+Atomic<uint32_t> DMAMappingObject::leaked_count_;
+
+DMAMappingObject::DMAMappingObject(Isolate* isolate, ArrayBufferPin* pin)
+    :	JsObjectWrapper(isolate),
+        pin_(pin) {
+    RT_ASSERT(pin_);
+    pin_->Pin();
+
+    size_t page_size { GLOBAL_mem_manager()->page_size() };
+    uint8_t* ptr { reinterpret_cast<uint8_t*>(pin_->data()) };
+    size_t left { pin_->length() };
+
+    // Split buffer on page boundaries, merge physically
+    // contiguous pages into single segment
+    while (left > 0) {
+        size_t in_page { page_size - (reinterpret_cast<uintptr_t>(ptr) & (page_size - 1)) };
+        size_t len { in_page < left ? in_page : left };
+
+        uint8_t* phys { reinterpret_cast<uint8_t*>(GLOBAL_mem_manager()->PinPage(ptr)) };
+        RT_ASSERT(phys);
+
+        if (!segments_.empty() && phys == reinterpret_cast<uint8_t*>(
+                segments_.back().address()) + segments_.back().length()) {
+            segments_.back().Extend(len);
+        } else {
+            segments_.push_back(DMASegment(phys, len));
+        }
+
+        ptr += len;
+        left -= len;
+    }
+}
+
+bool DMAMappingObject::IsBelow4GiB(ArrayBufferPin* pin) {
+    RT_ASSERT(pin);
+    size_t page_size { GLOBAL_mem_manager()->page_size() };
+    uint8_t* ptr { reinterpret_cast<uint8_t*>(pin->data()) };
+    uint8_t* end { ptr + pin->length() };
+
+    while (ptr < end) {
+        size_t in_page { page_size - (reinterpret_cast<uintptr_t>(ptr) & (page_size - 1)) };
+        size_t len { in_page < static_cast<size_t>(end - ptr) ? in_page : end - ptr };
+
+        uintptr_t phys { reinterpret_cast<uintptr_t>(GLOBAL_mem_manager()->PinPage(ptr)) };
+        RT_ASSERT(phys);
+        if (phys + len > 0x100000000ULL) {
+            return false;
+        }
+
+        ptr += len;
+    }
+
+    return true;
+}
+
+NATIVE_FUNCTION(DMAMappingObject, Segments) {
+    PROLOGUE;
+    LOCAL_V8STRING(s_address, "address");
+    LOCAL_V8STRING(s_length, "length");
+
+    if (nullptr == that->pin_) {
+        THROW_ERROR("segments: mapping is not pinned");
+    }
+
+    v8::Local<v8::Array> arr { v8::Array::New(iv8, that->segments_.size()) };
+    for (uint32_t i = 0; i < that->segments_.size(); ++i) {
+        const DMASegment& seg = that->segments_[i];
+        v8::Local<v8::Object> item { v8::Object::New(iv8) };
+        item->Set(s_address, v8::Number::New(iv8,
+            static_cast<double>(reinterpret_cast<uintptr_t>(seg.address()))));
+        item->Set(s_length, v8::Uint32::New(iv8, static_cast<uint32_t>(seg.length())));
+        arr->Set(i, item);
+    }
+
+    args.GetReturnValue().Set(arr);
+}
+
+NATIVE_FUNCTION(DMAMappingObject, Unpin) {
+    PROLOGUE;
+
+    if (nullptr == that->pin_) {
+        THROW_ERROR("unpin: mapping is not pinned");
+    }
+
+    // Buffer contents may be released after this call
+    that->pin_->Unpin();
+    that->pin_ = nullptr;
+    that->segments_.clear();
+}
+
 } // namespace rt
 
@@ -18,6 +18,8 @@
 #include <kernel/string.h>
 #include <kernel/v8utils.h>
 #include <kernel/template-cache.h>
+#include <kernel/vector.h>
+#include <kernel/atomic.h>
 #include <acpi.h>
 
 namespace rt {
@@ -32,13 +34,12 @@ public:
 
     DECLARE_NATIVE(CallHandler);
     DECLARE_NATIVE(Timeout);
+    DECLARE_NATIVE(Yield);
     DECLARE_NATIVE(KernelLog);
     DECLARE_NATIVE(InitrdText);
     DECLARE_NATIVE(KernelLoaderCallback);
     DECLARE_NATIVE(Resources);
     DECLARE_NATIVE(Args);
-    DECLARE_NATIVE(InstallInternals);
-    DECLARE_NATIVE(CallResult);
     DECLARE_NATIVE(Debug);
     DECLARE_NATIVE(StopVideoLog);
 
@@ -47,17 +48,34 @@ public:
      */
     DECLARE_NATIVE(InitrdList);
 
+    /**
+     * Get array of NUMA nodes physical memory usage
+     */
+    DECLARE_NATIVE(MemoryNodes);
+
+    /**
+     * Get thread stacks count, committed memory and size limit
+     */
+    DECLARE_NATIVE(StackInfo);
+
+    /**
+     * Get monotonic clock value in nanoseconds
+     */
+    DECLARE_NATIVE(ClockNanoseconds);
+
     void ObjectInit(ExportBuilder obj) {
         obj.SetCallback("timeout", Timeout);
+        obj.SetCallback("yield", Yield);
         obj.SetCallback("kernelLog", KernelLog);
         obj.SetCallback("resources", Resources);
         obj.SetCallback("args", Args);
-        obj.SetCallback("installInternals", InstallInternals);
-        obj.SetCallback("callResult", CallResult);
         obj.SetCallback("initrdText", InitrdText);
         obj.SetCallback("debug", Debug);
         obj.SetCallback("stopVideoLog", StopVideoLog);
         obj.SetCallback("initrdList", InitrdList);
+        obj.SetCallback("memoryNodes", MemoryNodes);
+        obj.SetCallback("stackInfo", StackInfo);
+        obj.SetCallback("clockNanoseconds", ClockNanoseconds);
     }
 };
 
@@ -147,10 +165,14 @@ public:
     }
 
     DECLARE_NATIVE(GetPciDevices);
+    DECLARE_NATIVE(GetPciIrqRoutes);
+    DECLARE_NATIVE(GetNamespace);
     DECLARE_NATIVE(SystemReset);
 
     void ObjectInit(ExportBuilder obj) {
         obj.SetCallback("getPciDevices", GetPciDevices);
+        obj.SetCallback("getPciIrqRoutes", GetPciIrqRoutes);
+        obj.SetCallback("getNamespace", GetNamespace);
         obj.SetCallback("systemReset", SystemReset);
     }
 private:
@@ -235,6 +257,24 @@ private:
     ResourceHandle<ResourceIRQ> obj_;
 };
 
+class ResourceKeyboardObject : public JsObjectWrapper<ResourceKeyboardObject,
+        NativeTypeId::TYPEID_RESOURCE_KEYBOARD> {
+public:
+    explicit ResourceKeyboardObject(Isolate* isolate)
+        :	JsObjectWrapper(isolate) { }
+
+    /**
+     * Bind keyboard controller handler, function receives array of
+     * scancodes drained in IRQ context since previous call. Only
+     * one handler can be bound, second call throws
+     */
+    DECLARE_NATIVE(OnScancodes);
+
+    void ObjectInit(ExportBuilder obj) {
+        obj.SetCallback("onScancodes", OnScancodes);
+    }
+};
+
 class ResourceMemoryBlockObject : public JsObjectWrapper<ResourceMemoryBlockObject,
         NativeTypeId::TYPEID_RESOURCE_MEMORY_BLOCK> {
 public:
@@ -292,6 +332,153 @@ private:
     ResourceHandle<ProcessManager> proc_mgr_;
 };
 
+/**
+ * Keeps ArrayBuffer contents available to devices. Buffer contents
+ * are externalized on first pin and released using ArrayBuffer
+ * allocator when buffer is collected and there are no pins left.
+ * Unpinned buffer can still be transferred to another isolate.
+ * Buffers externalized outside of kernel can't be pinned, V8 doesn't
+ * expose their contents pointer
+ */
+class ArrayBufferPin {
+public:
+    /**
+     * Get pin record for buffer, creates one if required. Returns
+     * nullptr for external buffers not created by kernel
+     */
+    static ArrayBufferPin* FromBuffer(v8::Isolate* iv8,
+                                      v8::Local<v8::ArrayBuffer> buffer);
+
+    /**
+     * Get existing pin record for buffer, returns nullptr
+     * if buffer has never been pinned
+     */
+    static ArrayBufferPin* Find(v8::Isolate* iv8,
+                                v8::Local<v8::ArrayBuffer> buffer);
+
+    /**
+     * Create pin record for external buffer kernel
+     * already knows contents of
+     */
+    static ArrayBufferPin* Attach(v8::Isolate* iv8, v8::Local<v8::ArrayBuffer> buffer,
+                                  void* data, size_t length, bool owns_contents);
+
+    void Pin() {
+        if (0 == pin_count_++) {
+            buffer_.ClearWeak();
+        }
+    }
+
+    void Unpin() {
+        RT_ASSERT(pin_count_ > 0);
+        if (0 == --pin_count_) {
+            buffer_.SetWeak(this, WeakCallback);
+        }
+    }
+
+    /**
+     * Give up kernel owned contents so buffer can be moved to
+     * another isolate. Returns false if buffer is pinned or
+     * contents are not owned by kernel
+     */
+    bool TakeContents(void** data, size_t* length) {
+        RT_ASSERT(data);
+        RT_ASSERT(length);
+        if (pin_count_ > 0 || !owns_contents_ || nullptr == data_) {
+            return false;
+        }
+
+        *data = data_;
+        *length = length_;
+        data_ = nullptr;
+        length_ = 0;
+        owns_contents_ = false;
+        return true;
+    }
+
+    void* data() const { return data_; }
+    size_t length() const { return length_; }
+
+    ~ArrayBufferPin();
+private:
+    ArrayBufferPin(v8::Isolate* iv8, v8::Local<v8::ArrayBuffer> buffer,
+                   void* data, size_t length, bool owns_contents)
+        :	buffer_(iv8, buffer),
+            data_(data),
+            length_(length),
+            owns_contents_(owns_contents),
+            pin_count_(0) {
+        buffer_.SetWeak(this, WeakCallback);
+    }
+
+    static void WeakCallback(const v8::WeakCallbackData<v8::ArrayBuffer,
+                             ArrayBufferPin>& data) {
+        delete data.GetParameter();
+    }
+
+    v8::UniquePersistent<v8::ArrayBuffer> buffer_;
+    void* data_;
+    size_t length_;
+    bool owns_contents_;
+    uint32_t pin_count_;
+    DELETE_COPY_AND_ASSIGN(ArrayBufferPin);
+};
+
+/**
+ * Physically contiguous part of pinned buffer
+ */
+class DMASegment {
+public:
+    DMASegment(void* address, size_t length)
+        :	address_(address),
+            length_(length) { }
+
+    void* address() const { return address_; }
+    size_t length() const { return length_; }
+    void Extend(size_t length) { length_ += length; }
+private:
+    void* address_;
+    size_t length_;
+};
+
+class DMAMappingObject : public JsObjectWrapper<DMAMappingObject,
+    NativeTypeId::TYPEID_DMA_MAPPING> {
+public:
+    DMAMappingObject(Isolate* isolate, ArrayBufferPin* pin);
+
+    ~DMAMappingObject() {
+        // Device may still use segments copied into its descriptors,
+        // buffer stays pinned and leaks without explicit unpin
+        if (nullptr != pin_) {
+            uint32_t leaked = leaked_count_.AddFetch(1);
+            printf("[DMA] mapping collected without unpin, %d leaked\n", leaked);
+        }
+    }
+
+    /**
+     * Number of mappings collected while still pinned
+     */
+    static uint32_t leaked_count() { return leaked_count_.Get(); }
+
+    /**
+     * Check if all buffer pages are below 4 GiB and can be
+     * used by devices with 32 bit DMA addressing
+     */
+    static bool IsBelow4GiB(ArrayBufferPin* pin);
+
+    DECLARE_NATIVE(Segments);
+    DECLARE_NATIVE(Unpin);
+
+    void ObjectInit(ExportBuilder obj) {
+        obj.SetCallback("segments", Segments);
+        obj.SetCallback("unpin", Unpin);
+    }
+private:
+    static Atomic<uint32_t> leaked_count_;
+    ArrayBufferPin* pin_;
+    SharedSTLVector<DMASegment> segments_;
+};
+
 class AllocatorObject : public JsObjectWrapper<AllocatorObject,
     NativeTypeId::TYPEID_ALLOCATOR> {
 public:
@@ -302,8 +489,18 @@ public:
 
     DECLARE_NATIVE(AllocDMA);
 
+    /**
+     * Pin ArrayBuffer memory and get list of physical segments
+     * for device descriptors, returns mapping object. Buffer stays
+     * alive until mapping is unpinned, collected mapping never
+     * unpins it. Pinned buffer can't be transferred to another
+     * process, unpinned one can
+     */
+    DECLARE_NATIVE(PinDMA);
+
     void ObjectInit(ExportBuilder obj) {
         obj.SetCallback("allocDMA", AllocDMA);
+        obj.SetCallback("pinDMA", PinDMA);
     }
 private:
 };
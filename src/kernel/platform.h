@@ -16,6 +16,7 @@
 #include <kernel/kernel.h>
 #include <kernel/mem-manager.h>
 #include <kernel/irq-dispatcher.h>
+#include <kernel/cross-call.h>
 #include <kernel/system-context.h>
 
 #ifdef RUNTIMEJS_PLATFORM_X64
@@ -31,7 +32,8 @@ namespace rt {
  */
 class Platform {
 public:
-    Platform() {}
+    Platform()
+        :	cross_calls_(platform_arch_.cpu_count()) {}
 
     /**
      * Start all other available CPUs
@@ -41,7 +43,10 @@ public:
     /**
      * Initialize per-cpu data
      */
-    void InitCurrentCPU() { platform_arch_.InitCurrentCPU(); }
+    void InitCurrentCPU() {
+        platform_arch_.InitCurrentCPU();
+        cross_calls_.CpuOnline();
+    }
 
     /**
      * Returns number of available CPUs in the system
@@ -52,6 +57,13 @@ public:
         return cpus_count;
     }
 
+    /**
+     * Returns package, core and SMT thread IDs of CPU
+     */
+    CpuTopology cpu_topology(uint32_t cpu) const {
+        return platform_arch_.cpu_topology(cpu);
+    }
+
     /**
      * Returns CPU bus frequency
      */
@@ -59,11 +71,71 @@ public:
         return platform_arch_.bus_frequency();
     }
 
+    /**
+     * Monotonic clock in nanoseconds, HPET based if
+     * available, TSC otherwise
+     */
+    uint64_t clock_nanoseconds() {
+        return platform_arch_.ClockNanoseconds();
+    }
+
+    /**
+     * Clock maintenance on timer interrupt (requires IRQ context)
+     */
+    void TimerTick() { platform_arch_.TimerTick(); }
+
+    /**
+     * Create buffer for keyboard controller data, drained on keyboard IRQ
+     */
+    std::unique_ptr<IrqDataSource> CreateKeyboardDataSource() {
+        return std::unique_ptr<IrqDataSource>(platform_arch_.CreateKeyboardDataSource());
+    }
+
+    /**
+     * IRQ number keyboard controller is wired to
+     */
+    uint8_t keyboard_irq() const { return platform_arch_.keyboard_irq(); }
+
     /**
      * Returns IRQ dispatcher for current platform
      */
     IrqDispatcher& irq_dispatcher() { return irq_dispatcher_; }
 
+    /**
+     * Returns remote function call facility
+     */
+    CrossCalls& cross_calls() { return cross_calls_; }
+
+    /**
+     * Interrupt CPU to handle its cross call queue
+     */
+    void SendCrossCallIPI(uint32_t cpu) {
+        platform_arch_.SendCrossCallIPI(cpu);
+    }
+
+    /**
+     * Invalidate TLB entry for single page on current CPU
+     */
+    void InvalidatePage(void* virtaddr) {
+        platform_arch_.InvalidatePage(virtaddr);
+    }
+
+    /**
+     * Flush all non-global TLB entries on current CPU
+     */
+    void InvalidateAll() { platform_arch_.InvalidateAll(); }
+
+    /**
+     * Read PCI configuration space of segment 0
+     */
+    uint8_t PciReadB(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+        return platform_arch_.PciReadB(bus, slot, func, offset);
+    }
+
+    uint16_t PciReadW(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+        return platform_arch_.PciReadW(bus, slot, func, offset);
+    }
+
     /**
      * IRQ handler (requires IRQ context)
      */
@@ -72,6 +144,11 @@ public:
         platform_arch_.AckIRQ();
     }
 
+    /**
+     * Signal end of interrupt on current CPU (requires IRQ context)
+     */
+    void AckIRQ() { platform_arch_.AckIRQ(); }
+
     /**
      * Print current stack backtrace
      */
@@ -79,6 +156,7 @@ public:
 private:
     PlatformArch platform_arch_;
     IrqDispatcher irq_dispatcher_;
+    CrossCalls cross_calls_;
     DELETE_COPY_AND_ASSIGN(Platform);
 };
 
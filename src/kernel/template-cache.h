@@ -36,12 +36,14 @@ enum class NativeTypeId : uint32_t {
     TYPEID_RESOURCE_MEMORY_BLOCK,
     TYPEID_RESOURCE_IRQ_RANGE,
     TYPEID_RESOURCE_IRQ,
+    TYPEID_RESOURCE_KEYBOARD,
     TYPEID_RESOURCE_IO_PORT,
     TYPEID_RESOURCE_IO_RANGE,
     TYPEID_PROCESS_HANDLE,
     TYPEID_PROCESS_MANAGER_HANDLE,
     TYPEID_ALLOCATOR,
     TYPEID_FUNCTION,
+    TYPEID_DMA_MAPPING,
 
     LAST // Keep it as the last element
 };
@@ -46,12 +46,16 @@ extern "C" void threadStructInit(void* thread_state,
 void ThreadManager::ThreadInit(Thread* t) {
     RT_ASSERT(t);
     RT_ASSERT(t->GetStackBottom());
-    threadStructInit(t->_fxstate, ThreadEntryPoint, t->GetStackBottom(), t);
+
+    // XRSTOR requires reserved XSAVE header bytes to be zero
+    memset(t->thread_state(), 0, Thread::kThreadStateSize);
+    threadStructInit(t->thread_state(), ThreadEntryPoint, t->GetStackBottom(), t);
 }
 
 
 void Preempt(Isolate* isolate) {
     RT_ASSERT(isolate);
+    isolate->FireTimers();
     Thread* curr_thread = isolate->current_thread();
     Thread* new_thread = isolate->thread_manager()->SwitchToNextThread();
 
@@ -61,7 +65,7 @@ void Preempt(Isolate* isolate) {
         return;
     }
 
-    preemptStart(curr_thread->_fxstate, new_thread->_fxstate);
+    preemptStart(curr_thread->thread_state(), new_thread->thread_state());
 }
 
 } // namespace rt
@@ -72,9 +72,14 @@ class ThreadManager {
 public:
     ThreadManager(Isolate* isolate);
 
-    Thread* CreateThread(String name, ResourceHandle<EngineThread> ethread) {
+    /**
+     * Create thread which runs in engine isolate or in its
+     * own dedicated isolate
+     */
+    Thread* CreateThread(Isolate* isolate, String name, ResourceHandle<EngineThread> ethread) {
+        RT_ASSERT(isolate);
         RT_ASSERT(!ethread.empty());
-        Thread* t = new Thread(isolate_, next_thread_id_++, name, ethread);
+        Thread* t = new Thread(isolate, next_thread_id_++, name, ethread);
         ThreadInit(t);
         threads_.push_back(ThreadBlock(t));
         return t;
@@ -97,7 +102,7 @@ public:
         asm volatile("cli");
         current_thread_index_ = 0;
         current_thread_ = threads_[current_thread_index_].thread();
-        enterFirstThread(current_thread_->_fxstate);
+        enterFirstThread(current_thread_->thread_state());
     }
 
 
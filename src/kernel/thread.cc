@@ -19,9 +19,34 @@
 #include <kernel/mem-manager.h>
 #include <kernel/engine.h>
 #include <kernel/engines.h>
+#include <kernel/irq-data-source.h>
 
 namespace rt {
 
+namespace {
+
+/**
+ * Handler for promise returned by exported function,
+ * data is [caller thread, caller promise index]
+ */
+template<bool resolve>
+void SettleCallResult(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    PROLOGUE_NOTHIS;
+    Thread* th = isolate->current_thread();
+    RT_ASSERT(th);
+
+    v8::Local<v8::Array> data { v8::Local<v8::Array>::Cast(args.Data()) };
+    v8::Local<v8::Value> ext { data->Get(0) };
+    RT_ASSERT(ext->IsExternal());
+    void* val { v8::Local<v8::External>::Cast(ext)->Value() };
+    RT_ASSERT(val);
+
+    th->SendCallResult(ResourceHandle<EngineThread>(static_cast<EngineThread*>(val)),
+                       resolve, data->Get(1)->Uint32Value(), args[0]);
+}
+
+} // namespace
+
 Thread::Thread(Isolate* isolate, uint64_t id,
     String name, ResourceHandle<EngineThread> ethread)
     :	isolate_(isolate),
@@ -64,6 +89,29 @@ v8::Local<v8::Value> FunctionExports::Get(uint32_t index, size_t export_id) {
 }
 
 
+void Thread::SendCallResult(ResourceHandle<EngineThread> recv, bool resolve,
+                            uint32_t promise_index, v8::Local<v8::Value> value) {
+    LockingPtr<EngineThread> lptr { recv.get() };
+    Isolate* isolate_recv { lptr->isolate() };
+    RT_ASSERT(isolate_recv);
+
+    TransportData data;
+    TransportData::SerializeError err { data.MoveValue(this, isolate_recv, value) };
+    if (TransportData::SerializeError::NONE != err) {
+        resolve = false;
+        data.MoveValue(this, isolate_recv, v8::Null(iv8_));
+    }
+
+    {	std::unique_ptr<ThreadMessage> msg(new ThreadMessage(
+            resolve ?
+                ThreadMessage::Type::FUNCTION_RETURN_RESOLVE :
+                ThreadMessage::Type::FUNCTION_RETURN_REJECT,
+            handle(),
+            std::move(data), nullptr, promise_index));
+        lptr->PushMessage(std::move(msg));
+    }
+}
+
 void Thread::Init() {
     isolate_->Init();
 }
@@ -71,26 +119,15 @@ void Thread::Init() {
 void Thread::SetTimeout(uint32_t timeout_id, uint64_t timeout_ms) {
     uint64_t ticks_now { isolate_->ticks_count() };
     uint64_t when = ticks_now + timeout_ms / GLOBAL_engines()->MsPerTick();
-    timeouts_.Set(timeout_id, when);
+    isolate_->SetTimer(ethread_, timeout_id, when);
 }
 
 void Thread::Run() {
     v8::Isolate* iv8 = isolate_->IsolateV8();
     RT_ASSERT(iv8);
 
-    uint64_t ticks_now { isolate_->ticks_count() };
-    while (timeouts_.Elapsed(ticks_now)) {
-        uint32_t timeout_id { timeouts_.Take() };
-
-        {	std::unique_ptr<ThreadMessage> msg(new ThreadMessage(
-                ThreadMessage::Type::TIMEOUT_EVENT,
-                ResourceHandle<EngineThread>(), TransportData(), nullptr, timeout_id));
-            ethread_.get()->PushMessage(std::move(msg));
-        }
-    }
-
     EngineThread::ThreadMessagesVector messages = ethread_.get()->TakeMessages();
-    if (0 == messages.size()) {
+    if (0 == messages.size() && immediates_.empty()) {
         return;
     }
 
@@ -98,6 +135,13 @@ void Thread::Run() {
     v8::Isolate::Scope ivscope(iv8);
     v8::HandleScope local_handle_scope(iv8);
 
+    // Limit is per thread and V8 computes default one from current
+    // stack position, it should match growable stack instead.
+    // V8 throws RangeError before stack reaches its guard area
+    v8::ResourceConstraints constraints;
+    constraints.set_stack_limit(reinterpret_cast<uint32_t*>(GetStackLimit()));
+    v8::SetResourceConstraints(iv8, &constraints);
+
     if (context_.IsEmpty()) {
 
         printf("++++++++++++++++ CONTEXT (X0)\n");
@@ -111,10 +155,25 @@ void Thread::Run() {
 
     v8::TryCatch trycatch;
 
+    // Promise reactions for consecutive call results are run by a
+    // single microtask checkpoint. Results are still settled in the
+    // order they arrived, and reactions run in the same order, but a
+    // reaction can observe later results of the same batch already
+    // settled. Checkpoint always runs before any other message is
+    // handled, so timeouts, IRQs and calls see all reactions done
+    uint32_t settled_count = 0;
+
     for (ThreadMessage* message : messages) {
         RT_ASSERT(message);
 
         ThreadMessage::Type type = message->type();
+        bool is_result = ThreadMessage::Type::FUNCTION_RETURN_RESOLVE == type ||
+                         ThreadMessage::Type::FUNCTION_RETURN_REJECT == type;
+
+        if (settled_count > 0 && (!is_result || settled_count >= kMaxResultsPerCheckpoint)) {
+            iv8->RunMicrotasks();
+            settled_count = 0;
+        }
 
         switch (type) {
         case ThreadMessage::Type::SET_ARGUMENTS: {
@@ -144,22 +203,46 @@ void Thread::Run() {
             ExternalFunction* efn { message->exported_func() };
             RT_ASSERT(efn);
 
+            ResourceHandle<EngineThread> sender { message->sender() };
+            uint32_t promise_index = message->recv_index();
+
             v8::Local<v8::Value> fnval { exports_.Get(efn->index(), efn->export_id()) };
             if (fnval.IsEmpty()) {
-                fnval = v8::Null(iv8);
-            } else {
-                RT_ASSERT(fnval->IsFunction());
+                // Invalid function call
+                SendCallResult(sender, false, promise_index, v8::Null(iv8));
+                break;
+            }
+
+            RT_ASSERT(fnval->IsFunction());
+            RT_ASSERT(unpacked->IsArray());
+            v8::Local<v8::Function> fn { v8::Local<v8::Function>::Cast(fnval) };
+            v8::Local<v8::Array> fnargs { v8::Local<v8::Array>::Cast(unpacked) };
+
+            uint32_t argc = fnargs->Length();
+            SharedSTLVector<v8::Local<v8::Value>> argv(argc);
+            for (uint32_t i = 0; i < argc; ++i) {
+                argv[i] = fnargs->Get(i);
+            }
+
+            v8::Local<v8::Value> ret { fn->Call(context->Global(), argc, argv.data()) };
+            if (ret.IsEmpty()) {
+                // Exception is reported below, caller gets it too
+                SendCallResult(sender, false, promise_index, trycatch.Exception());
+                break;
             }
 
-            {	v8::Local<v8::Function> fnwrap { v8::Local<v8::Function>::New(iv8, call_wrapper_) };
-                v8::Local<v8::Value> argv[] {
-                   fnval,
-                   message->sender().NewExternal(iv8),
-                   unpacked,
-                   v8::Uint32::NewFromUnsigned(iv8, message->recv_index()),
-                };
-                fnwrap->Call(context->Global(), 4, argv);
+            if (!ret->IsPromise()) {
+                SendCallResult(sender, true, promise_index, ret);
+                break;
             }
+
+            // Settle caller promise when this one is settled
+            v8::Local<v8::Promise> promise { v8::Local<v8::Promise>::Cast(ret) };
+            v8::Local<v8::Array> data { v8::Array::New(iv8, 2) };
+            data->Set(0, sender.NewExternal(iv8));
+            data->Set(1, v8::Uint32::NewFromUnsigned(iv8, promise_index));
+            promise->Then(v8::Function::New(iv8, SettleCallResult<true>, data));
+            promise->Catch(v8::Function::New(iv8, SettleCallResult<false>, data));
         }
             break;
         case ThreadMessage::Type::FUNCTION_RETURN_RESOLVE: {
@@ -169,8 +252,11 @@ void Thread::Run() {
             v8::Local<v8::Promise::Resolver> resolver {
                 v8::Local<v8::Promise::Resolver>::New(iv8, TakePromise(message->recv_index())) };
 
-            resolver->Resolve(unpacked);
-            isolate_->IsolateV8()->RunMicrotasks();
+            {	// Don't run reactions on return from API call
+                v8::Isolate::SuppressMicrotaskExecutionScope suppress(iv8);
+                resolver->Resolve(unpacked);
+            }
+            ++settled_count;
         }
             break;
         case ThreadMessage::Type::FUNCTION_RETURN_REJECT: {
@@ -180,8 +266,11 @@ void Thread::Run() {
             v8::Local<v8::Promise::Resolver> resolver {
                 v8::Local<v8::Promise::Resolver>::New(iv8, TakePromise(message->recv_index())) };
 
-            resolver->Reject(unpacked);
-            isolate_->IsolateV8()->RunMicrotasks();
+            {	// Don't run reactions on return from API call
+                v8::Isolate::SuppressMicrotaskExecutionScope suppress(iv8);
+                resolver->Reject(unpacked);
+            }
+            ++settled_count;
         }
             break;
         case ThreadMessage::Type::TIMEOUT_EVENT: {
@@ -200,6 +289,27 @@ void Thread::Run() {
             fn->Call(context->Global(), 0, nullptr);
         }
             break;
+        case ThreadMessage::Type::IRQ_DATA: {
+            uint8_t codes[IrqDataSource::kMaxBatch];
+            uint32_t count { message->data_source()->Take(codes, sizeof(codes)) };
+            if (0 == count) {
+                break;
+            }
+
+            v8::Local<v8::Value> fnv { v8::Local<v8::Value>::New(iv8,
+                GetIRQData(message->recv_index())) };
+            RT_ASSERT(fnv->IsFunction());
+            v8::Local<v8::Function> fn { v8::Local<v8::Function>::Cast(fnv) };
+
+            v8::Local<v8::Array> arr { v8::Array::New(iv8, count) };
+            for (uint32_t i = 0; i < count; ++i) {
+                arr->Set(i, v8::Uint32::New(iv8, codes[i]));
+            }
+
+            v8::Local<v8::Value> argv[] { arr };
+            fn->Call(context->Global(), 1, argv);
+        }
+            break;
         case ThreadMessage::Type::EMPTY:
             break;
         default:
@@ -212,6 +322,20 @@ void Thread::Run() {
         }
     }
 
+    if (settled_count > 0) {
+        iv8->RunMicrotasks();
+    }
+
+    // Functions queued while running these go to the next run
+    SharedSTLVector<v8::UniquePersistent<v8::Value>> immediates;
+    immediates.swap(immediates_);
+    for (v8::UniquePersistent<v8::Value>& fnp : immediates) {
+        v8::Local<v8::Value> fnv { v8::Local<v8::Value>::New(iv8, fnp) };
+        RT_ASSERT(fnv->IsFunction());
+        v8::Local<v8::Function> fn { v8::Local<v8::Function>::Cast(fnv) };
+        fn->Call(context->Global(), 0, nullptr);
+    }
+
     v8::Local<v8::Value> ex = trycatch.Exception();
     if (!ex.IsEmpty()) {
         v8::String::Utf8Value exception_str(ex);
@@ -99,6 +99,15 @@ public:
         return stack_pos;
     }
 
+    /**
+     * Lowest stack address V8 is allowed to use, margin is
+     * left for native code and interrupt handlers
+     */
+    uintptr_t GetStackLimit() const {
+        RT_ASSERT(stack_.len() > kStackLimitMargin);
+        return reinterpret_cast<uintptr_t>(stack_.top()) + kStackLimitMargin;
+    }
+
     LocalStorage& GetLocalStorage() {
         return local_storage_;
     }
@@ -117,6 +126,10 @@ public:
         return irq_data_.Push(std::move(v));
     }
 
+    v8::UniquePersistent<v8::Value> TakeIRQData(uint32_t index) {
+        return irq_data_.Take(index);
+    }
+
     v8::Local<v8::Value> GetIRQData(uint32_t index) {
         v8::EscapableHandleScope scope(iv8_);
         return scope.Escape(irq_data_.GetLocal(iv8_, index));
@@ -130,6 +143,16 @@ public:
         return timeout_data_.Take(index);
     }
 
+    /**
+     * Queue function to run on the next thread switch. Thread
+     * priority is not raised, so other runnable threads are
+     * scheduled first
+     */
+    void AddImmediate(v8::Local<v8::Value> fn) {
+        RT_ASSERT(fn->IsFunction());
+        immediates_.push_back(std::move(v8::UniquePersistent<v8::Value>(iv8_, fn)));
+    }
+
     uint32_t AddPromise(v8::UniquePersistent<v8::Promise::Resolver> resolver) {
         return promises_.Push(std::move(resolver));
     }
@@ -150,12 +173,13 @@ public:
         priority_.Set(1);
     }
 
-    void SetCallWrapper(v8::Local<v8::Function> fn) {
-        RT_ASSERT(call_wrapper_.IsEmpty());
-        RT_ASSERT(!fn.IsEmpty());
-        RT_ASSERT(fn->IsFunction());
-        call_wrapper_ = std::move(v8::UniquePersistent<v8::Function>(iv8_, fn));
-    }
+    /**
+     * Send result of exported function call back to caller
+     * thread to settle its promise. Values that can't be
+     * transferred reject promise with null
+     */
+    void SendCallResult(ResourceHandle<EngineThread> recv, bool resolve,
+                        uint32_t promise_index, v8::Local<v8::Value> value);
 
     void SetTimeout(uint32_t timeout_id, uint64_t timeout_ms);
 
@@ -169,19 +193,38 @@ public:
     }
 
     /**
-     * Thread state storage required for stack switch
+     * Thread state storage required for stack switch, layout
+     * is defined in irq-vectors-x64.asm. XSAVE requires 64 byte
+     * alignment which heap allocated thread does not guarantee
      */
-    uint8_t _fxstate[1024] alignas(16);
+    void* thread_state() {
+        return common::Utils::AlignPtr<uint8_t>(_fxstate, kThreadStateAlign);
+    }
+
+    static const size_t kThreadStateSize = 4096;
+    static const size_t kThreadStateAlign = 64;
 private:
+    uint8_t _fxstate[kThreadStateSize + kThreadStateAlign] alignas(16);
+
     Isolate* isolate_;
     v8::Isolate* iv8_;
     uint64_t id_;
     String name_;
 
     LocalStorage local_storage_;
+    /**
+     * Maximum number of call results settled in a row before
+     * promise reactions are run
+     */
+    static const uint32_t kMaxResultsPerCheckpoint = 256;
+
+    /**
+     * Stack space below V8 stack limit
+     */
+    static const uintptr_t kStackLimitMargin = 256 * common::Constants::KiB;
+
     v8::UniquePersistent<v8::Context> context_;
     v8::UniquePersistent<v8::Value> args_;
-    v8::UniquePersistent<v8::Function> call_wrapper_;
 
     VirtualStack stack_;
 //    AtomicUINT32 priority_;
@@ -189,11 +232,11 @@ private:
 
     ResourceHandle<EngineThread> ethread_;
     FunctionExports exports_;
-    Timeouts<uint32_t> timeouts_;
 
     UniquePersistentIndexedPool<v8::Value> timeout_data_;
     UniquePersistentIndexedPool<v8::Value> irq_data_;
     UniquePersistentIndexedPool<v8::Promise::Resolver> promises_;
+    SharedSTLVector<v8::UniquePersistent<v8::Value>> immediates_;
 };
 
 } // namespace rt
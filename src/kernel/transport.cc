@@ -17,9 +17,99 @@
 #include <kernel/template-cache.h>
 #include <kernel/object-wrapper.h>
 #include <kernel/thread.h>
+#include <kernel/native-object.h>
 
 namespace rt {
 
+namespace {
+
+/**
+ * Returns empty handle if global was overwritten by user code
+ */
+v8::Local<v8::Function> GetGlobalConstructor(v8::Isolate* iv8, const char* name) {
+    v8::Local<v8::Context> context { iv8->GetCurrentContext() };
+    v8::Local<v8::Value> ctor { context->Global()->Get(v8::String::NewFromUtf8(iv8, name)) };
+    if (!ctor->IsFunction()) {
+        return v8::Local<v8::Function>();
+    }
+
+    return v8::Local<v8::Function>::Cast(ctor);
+}
+
+/**
+ * There is no Map and Set API in this V8 version, check
+ * constructor name first to keep plain objects path fast.
+ * Returns false if object has collection constructor name,
+ * but global constructor is gone and object can't be verified
+ */
+bool GetCollectionKind(v8::Isolate* iv8, v8::Local<v8::Object> obj,
+                       bool* is_map, bool* is_set) {
+    RT_ASSERT(is_map);
+    RT_ASSERT(is_set);
+    *is_map = false;
+    *is_set = false;
+
+    v8::String::Utf8Value ctor_name(obj->GetConstructorName());
+    if (nullptr == *ctor_name) {
+        return true;
+    }
+
+    bool map_name = 0 == strcmp(*ctor_name, "Map");
+    if (!map_name && 0 != strcmp(*ctor_name, "Set")) {
+        return true;
+    }
+
+    v8::Local<v8::Function> ctor { GetGlobalConstructor(iv8, map_name ? "Map" : "Set") };
+    if (ctor.IsEmpty()) {
+        return false;
+    }
+
+    v8::Local<v8::Value> proto { ctor->Get(v8::String::NewFromUtf8(iv8, "prototype")) };
+    if (obj->GetPrototype()->StrictEquals(proto)) {
+        *is_map = map_name;
+        *is_set = !map_name;
+    }
+
+    return true;
+}
+
+void DiscardEntry(const v8::FunctionCallbackInfo<v8::Value>& args) {}
+
+void CollectMapEntry(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::Local<v8::Array> items { v8::Local<v8::Array>::Cast(args.Data()) };
+    uint32_t len = items->Length();
+    items->Set(len, args[1]);
+    items->Set(len + 1, args[0]);
+}
+
+void CollectSetEntry(const v8::FunctionCallbackInfo<v8::Value>& args) {
+    v8::Local<v8::Array> items { v8::Local<v8::Array>::Cast(args.Data()) };
+    items->Set(items->Length(), args[0]);
+}
+
+/**
+ * Copy Map (as key, value pairs) or Set entries into array
+ * in insertion order
+ */
+v8::Local<v8::Array> CollectEntries(v8::Isolate* iv8, v8::Local<v8::Object> obj,
+                                    v8::FunctionCallback callback) {
+    v8::Local<v8::Array> items { v8::Array::New(iv8, 0) };
+    v8::Local<v8::Value> for_each { obj->Get(v8::String::NewFromUtf8(iv8, "forEach")) };
+    if (!for_each->IsFunction()) {
+        return v8::Local<v8::Array>();
+    }
+
+    v8::Local<v8::Value> argv[] { v8::Function::New(iv8, callback, items) };
+    v8::Local<v8::Value> ret { v8::Local<v8::Function>::Cast(for_each)->Call(obj, 1, argv) };
+    if (ret.IsEmpty()) {
+        return v8::Local<v8::Array>();
+    }
+
+    return items;
+}
+
+} // namespace
+
 TransportData::SerializeError TransportData::MoveValue(Thread* exporter,
                                                        Isolate* isolate_recv,
                                                        v8::Local<v8::Value> value) {
@@ -31,7 +121,8 @@ TransportData::SerializeError TransportData::MoveValue(Thread* exporter,
     isolate_ = isolate;
     allow_ref_ = isolate_recv == isolate;
 
-    SerializeError err { SerializeValue(exporter, value, 1) };
+    ObjectIdentityTable table;
+    SerializeError err { Serialize(exporter, value, table) };
     if (SerializeError::NONE != err) {
         SetUndefined();
     }
@@ -54,8 +145,12 @@ TransportData::SerializeError TransportData::MoveArgs(Thread* exporter,
     uint32_t len = args.Length();
     stream_.AppendValue<uint32_t>(len);
 
+    // Arguments list gets an index like any other array
+    ObjectIdentityTable table;
+    table.AddPlaceholder();
+
     for (uint32_t i = 0; i < len; ++i) {
-        SerializeError err { SerializeValue(exporter, args[i], 1) };
+        SerializeError err { Serialize(exporter, args[i], table) };
         if (SerializeError::NONE != err) {
             SetUndefined();
             return err;
@@ -85,16 +180,87 @@ uint32_t TransportData::AddRef(v8::Local<v8::Value> value) {
     return static_cast<uint32_t>(index);
 }
 
+TransportData::SerializeError TransportData::Serialize(Thread* exporter,
+                                                       v8::Local<v8::Value> value,
+                                                       ObjectIdentityTable& table) {
+    SharedSTLVector<SerializeFrame> stack;
+
+    SerializeError err { SerializeValue(exporter, value, table, stack) };
+    if (SerializeError::NONE != err) {
+        return err;
+    }
+
+    while (!stack.empty()) {
+        SerializeFrame& frame = stack.back();
+        if (frame.index >= frame.length) {
+            stack.pop_back();
+            continue;
+        }
+
+        // Frame reference is invalidated when nested container
+        // is pushed, take everything needed before that
+        uint32_t i = frame.index++;
+        v8::Local<v8::Object> obj { frame.obj };
+        v8::Local<v8::Value> item;
+
+        switch (frame.kind) {
+        case FrameKind::ARRAY:
+            item = obj->Get(i);
+            break;
+        case FrameKind::HASHMAP: {
+            v8::Local<v8::Value> k { frame.items->Get(i) };
+            err = SerializeValue(exporter, k, table, stack);
+            if (SerializeError::NONE != err) {
+                return err;
+            }
+
+            item = obj->Get(k);
+        }
+            break;
+        case FrameKind::LIST:
+            item = frame.items->Get(i);
+            break;
+        }
+
+        err = SerializeValue(exporter, item, table, stack);
+        if (SerializeError::NONE != err) {
+            return err;
+        }
+    }
+
+    return SerializeError::NONE;
+}
+
+bool TransportData::AppendInt32Array(v8::Local<v8::Array> a, uint32_t len) {
+    if (0 == len) {
+        return false;
+    }
+
+    // Encode optimistically, most arrays fail on the first element
+    size_t start = stream_.size();
+    AppendType(Type::INT32_ARRAY);
+    stream_.AppendVarUint(len);
+
+    for (uint32_t i = 0; i < len; ++i) {
+        v8::Local<v8::Value> item { a->Get(i) };
+        if (!item->IsInt32()) {
+            stream_.Truncate(start);
+            return false;
+        }
+
+        stream_.AppendVarInt(item->Int32Value());
+    }
+
+    return true;
+}
+
 TransportData::SerializeError TransportData::SerializeValue(Thread* exporter,
                                                             v8::Local<v8::Value> value,
-                                                            uint32_t stack_level) {
+                                                            ObjectIdentityTable& table,
+                                                            SharedSTLVector<SerializeFrame>& stack) {
     RT_ASSERT(exporter);
     RT_ASSERT(!value.IsEmpty());
 
-    if (stack_level > kMaxStackSize) {
-        return SerializeError::MAX_STACK;
-    }
-
     if (value->IsUndefined()) {
         AppendType(Type::UNDEFINED);
         return SerializeError::NONE;
@@ -111,14 +277,13 @@ TransportData::SerializeError TransportData::SerializeValue(Thread* exporter,
     }
 
     if (value->IsInt32()) {
-        AppendType(Type::INT32);
-        stream_.AppendValue<int32_t>(value->Int32Value());
+        AppendInt32(value->Int32Value());
         return SerializeError::NONE;
     }
 
     if (value->IsUint32()) {
         AppendType(Type::UINT32);
-        stream_.AppendValue<uint32_t>(value->Uint32Value());
+        stream_.AppendVarUint(value->Uint32Value());
         return SerializeError::NONE;
     }
 
@@ -147,16 +312,32 @@ TransportData::SerializeError TransportData::SerializeValue(Thread* exporter,
         return SerializeError::NONE;
     }
 
+    if (value->IsObject()) {
+        // Every object gets an index, deserializer assigns
+        // indexes in the same order
+        v8::Local<v8::Object> obj { value->ToObject() };
+        int hash = obj->GetIdentityHash();
+        uint32_t index = 0;
+        if (table.Find(hash, obj, &index)) {
+            AppendType(Type::BACKREF);
+            stream_.AppendValue<uint32_t>(index);
+            return SerializeError::NONE;
+        }
+
+        table.Add(hash, obj);
+    }
+
     if (value->IsArray()) {
-        AppendType(Type::ARRAY);
         v8::Local<v8::Array> a { v8::Local<v8::Array>::Cast(value) };
-        stream_.AppendValue<uint32_t>(a->Length());
+        uint32_t len = a->Length();
+        if (AppendInt32Array(a, len)) {
+            return SerializeError::NONE;
+        }
 
-        for (uint32_t i = 0; i < a->Length(); ++i) {
-            SerializeError err { SerializeValue(exporter, a->Get(i), stack_level + 1) };
-            if (SerializeError::NONE != err) {
-                return err;
-            }
+        AppendType(Type::ARRAY);
+        stream_.AppendValue<uint32_t>(len);
+        if (len > 0) {
+            stack.push_back(SerializeFrame(FrameKind::ARRAY, a, v8::Local<v8::Array>(), len));
         }
 
         return SerializeError::NONE;
@@ -166,12 +347,21 @@ TransportData::SerializeError TransportData::SerializeValue(Thread* exporter,
         // Neuter this array buffer and take its contents
         AppendType(Type::ARRAYBUFFER);
         v8::Local<v8::ArrayBuffer> b { v8::Local<v8::ArrayBuffer>::Cast(value) };
+        void* data = nullptr;
+        size_t length = 0;
         if (b->IsExternal()) {
-            return SerializeError::EXTERNAL_BUFFER;
+            // Buffer externalized by pinDMA can be moved once unpinned
+            ArrayBufferPin* pin { ArrayBufferPin::Find(isolate_->IsolateV8(), b) };
+            if (nullptr == pin || !pin->TakeContents(&data, &length)) {
+                return SerializeError::EXTERNAL_BUFFER;
+            }
+        } else {
+            v8::ArrayBuffer::Contents c { b->Externalize() };
+            data = c.Data();
+            length = c.ByteLength();
         }
-        v8::ArrayBuffer::Contents c { b->Externalize() };
-        stream_.AppendValue<void*>(c.Data());
-        stream_.AppendValue<size_t>(c.ByteLength());
+        stream_.AppendValue<void*>(data);
+        stream_.AppendValue<size_t>(length);
         b->Neuter();
 
         return SerializeError::NONE;
@@ -218,22 +408,51 @@ TransportData::SerializeError TransportData::SerializeValue(Thread* exporter,
             }
         }
 
-        AppendType(Type::HASHMAP);
-        v8::Local<v8::Array> a { obj->GetOwnPropertyNames() };
-        stream_.AppendValue<uint32_t>(a->Length());
-        for (uint32_t i = 0; i < a->Length(); ++i) {
-            v8::Local<v8::Value> k { a->Get(i) };
-            {	SerializeError err { SerializeValue(exporter, k, stack_level + 1) };
-                if (SerializeError::NONE != err) {
-                    return err;
-                }
+        if (value->IsDate()) {
+            AppendType(Type::DATE);
+            stream_.AppendValue<double>(v8::Local<v8::Date>::Cast(value)->ValueOf());
+            return SerializeError::NONE;
+        }
+
+        if (value->IsRegExp()) {
+            v8::Local<v8::RegExp> re { v8::Local<v8::RegExp>::Cast(value) };
+            AppendType(Type::REGEXP);
+            stream_.AppendValue<uint32_t>(static_cast<uint32_t>(re->GetFlags()));
+            return SerializeValue(exporter, re->GetSource(), table, stack);
+        }
+
+        v8::Isolate* iv8 { isolate_->IsolateV8() };
+        RT_ASSERT(iv8);
+
+        bool is_map = false;
+        bool is_set = false;
+        if (!GetCollectionKind(iv8, obj, &is_map, &is_set)) {
+            return SerializeError::INVALID_TYPE;
+        }
+
+        if (is_map || is_set) {
+            v8::Local<v8::Array> items { CollectEntries(iv8, obj,
+                is_map ? CollectMapEntry : CollectSetEntry) };
+            if (items.IsEmpty()) {
+                return SerializeError::INVALID_TYPE;
             }
 
-            {	SerializeError err { SerializeValue(exporter, obj->Get(k), stack_level + 1) };
-                if (SerializeError::NONE != err) {
-                    return err;
-                }
+            uint32_t len = items->Length();
+            AppendType(is_map ? Type::MAP : Type::SET);
+            stream_.AppendValue<uint32_t>(is_map ? len / 2 : len);
+            if (len > 0) {
+                stack.push_back(SerializeFrame(FrameKind::LIST, obj, items, len));
             }
+
+            return SerializeError::NONE;
+        }
+
+        AppendType(Type::HASHMAP);
+        v8::Local<v8::Array> a { obj->GetOwnPropertyNames() };
+        uint32_t len = a->Length();
+        stream_.AppendValue<uint32_t>(len);
+        if (len > 0) {
+            stack.push_back(SerializeFrame(FrameKind::HASHMAP, obj, a, len));
         }
 
         return SerializeError::NONE;
@@ -252,78 +471,196 @@ v8::Local<v8::Value> TransportData::Unpack(Isolate* isolate) const {
         RT_ASSERT(nullptr != isolate_);
     }
     v8::EscapableHandleScope scope(iv8);
-    return scope.Escape(UnpackValue(isolate, reader));
+
+    SharedSTLVector<v8::Local<v8::Value>> objects;
+    SharedSTLVector<UnpackFrame> stack;
+    v8::Local<v8::Value> root { UnpackValue(isolate, reader, objects, stack) };
+
+    while (!stack.empty()) {
+        UnpackFrame& frame = stack.back();
+        if (frame.index >= frame.length) {
+            stack.pop_back();
+            continue;
+        }
+
+        // Frame reference is invalidated when nested container
+        // is pushed, take everything needed before that
+        uint32_t i = frame.index++;
+        v8::Local<v8::Object> obj { frame.obj };
+
+        switch (frame.kind) {
+        case FrameKind::ARRAY:
+            obj->Set(i, UnpackValue(isolate, reader, objects, stack));
+            break;
+        case FrameKind::HASHMAP: {
+            v8::Local<v8::Value> k { UnpackValue(isolate, reader, objects, stack) };
+            v8::Local<v8::Value> v { UnpackValue(isolate, reader, objects, stack) };
+            obj->Set(k, v);
+        }
+            break;
+        case FrameKind::LIST: {
+            // Map key can be a container, so only one value is
+            // read per step and frame is looked up again
+            size_t frame_index = stack.size() - 1;
+            v8::Local<v8::Value> v { UnpackValue(isolate, reader, objects, stack) };
+            UnpackFrame& list = stack[frame_index];
+
+            if (!list.is_map) {
+                v8::Local<v8::Value> argv[] { v };
+                list.insert->Call(obj, 1, argv);
+            } else if (0 == (i & 1)) {
+                list.key = v;
+            } else {
+                v8::Local<v8::Value> argv[] { list.key, v };
+                list.insert->Call(obj, 2, argv);
+            }
+        }
+            break;
+        }
+    }
+
+    return scope.Escape(root);
 }
 
-v8::Local<v8::Value> TransportData::UnpackValue(Isolate* isolate, ByteStreamReader& reader) const {
+v8::Local<v8::Value> TransportData::UnpackValue(Isolate* isolate, ByteStreamReader& reader,
+                                                SharedSTLVector<v8::Local<v8::Value>>& objects,
+                                                SharedSTLVector<UnpackFrame>& stack) const {
     RT_ASSERT(isolate);
     v8::Isolate* iv8 { isolate->IsolateV8() };
     RT_ASSERT(iv8);
 
-    v8::EscapableHandleScope scope(iv8);
-    Type t { ReadType(reader) };
+    uint8_t tag = reader.ReadValue<uint8_t>();
+    if (tag & kSmallIntTag) {
+        return v8::Integer::New(iv8, tag & ~kSmallIntTag);
+    }
+
+    Type t { static_cast<Type>(tag) };
 
     switch (t) {
     case Type::UNDEFINED:
-        return scope.Escape<v8::Primitive>(v8::Undefined(iv8));
+        return v8::Undefined(iv8);
     case Type::NUL:
-        return scope.Escape<v8::Primitive>(v8::Null(iv8));
+        return v8::Null(iv8);
     case Type::STRING_UTF8: {
         uint32_t len = reader.ReadValue<uint32_t>();
-        return scope.Escape(v8::String::NewFromUtf8(iv8,
+        return v8::String::NewFromUtf8(iv8,
             reinterpret_cast<const char*>(reader.ReadBuffer(len + 1)),
-            v8::String::kNormalString, len));
+            v8::String::kNormalString, len);
     }
     case Type::STRING_16: {
         uint32_t len = reader.ReadValue<uint32_t>();
-        return scope.Escape(v8::String::NewFromTwoByte(iv8,
+        return v8::String::NewFromTwoByte(iv8,
             reinterpret_cast<const uint16_t*>(reader.ReadBuffer((len + 1) * sizeof(uint16_t))),
-            v8::String::kNormalString, len));
+            v8::String::kNormalString, len);
     }
     case Type::STRING_REF:
-    case Type::OBJECT_REF:
-        return scope.Escape(GetRef(iv8, reader.ReadValue<uint32_t>()));
+        return GetRef(iv8, reader.ReadValue<uint32_t>());
+    case Type::OBJECT_REF: {
+        v8::Local<v8::Value> obj { GetRef(iv8, reader.ReadValue<uint32_t>()) };
+        objects.push_back(obj);
+        return obj;
+    }
     case Type::INT32:
-        return scope.Escape<v8::Primitive>(v8::Int32::New(iv8,
-            reader.ReadValue<int32_t>()));
+        return v8::Integer::New(iv8, reader.ReadVarInt());
     case Type::UINT32:
-        return scope.Escape<v8::Primitive>(v8::Int32::New(iv8,
-            reader.ReadValue<uint32_t>()));
+        return v8::Integer::NewFromUnsigned(iv8, reader.ReadVarUint());
     case Type::DOUBLE:
-        return scope.Escape<v8::Primitive>(v8::Int32::New(iv8,
-            reader.ReadValue<double>()));
+        return v8::Number::New(iv8, reader.ReadValue<double>());
     case Type::BOOL_TRUE:
-        return scope.Escape<v8::Primitive>(v8::True(iv8));
+        return v8::True(iv8);
     case Type::BOOL_FALSE:
-        return scope.Escape<v8::Primitive>(v8::False(iv8));
+        return v8::False(iv8);
     case Type::ARRAYBUFFER: {
         void* buf = reader.ReadValue<void*>();
         size_t len = reader.ReadValue<size_t>();
-        return scope.Escape(v8::ArrayBuffer::NewNonExternal(iv8, buf, len));
+        v8::Local<v8::Value> b { v8::ArrayBuffer::NewNonExternal(iv8, buf, len) };
+        objects.push_back(b);
+        return b;
     }
     case Type::ARRAY: {
         uint32_t len = reader.ReadValue<uint32_t>();
         v8::Local<v8::Array> arr { v8::Array::New(iv8, len) };
+        objects.push_back(arr);
+        if (len > 0) {
+            stack.push_back(UnpackFrame(FrameKind::ARRAY, arr, len));
+        }
+        return arr;
+    }
+    case Type::INT32_ARRAY: {
+        uint32_t len = reader.ReadVarUint();
+        v8::Local<v8::Array> arr { v8::Array::New(iv8, len) };
+        objects.push_back(arr);
         for (uint32_t i = 0; i < len; ++i) {
-            arr->Set(i, UnpackValue(isolate, reader));
+            arr->Set(i, v8::Integer::New(iv8, reader.ReadVarInt()));
         }
-        return scope.Escape(arr);
+        return arr;
     }
     case Type::HASHMAP: {
         uint32_t len = reader.ReadValue<uint32_t>();
         v8::Local<v8::Object> obj { v8::Object::New(iv8) };
-        for (uint32_t i = 0; i < len; ++i) {
-            v8::Local<v8::Value> k { UnpackValue(isolate, reader) };
-            v8::Local<v8::Value> v { UnpackValue(isolate, reader) };
-            obj->Set(k, v);
+        objects.push_back(obj);
+        if (len > 0) {
+            stack.push_back(UnpackFrame(FrameKind::HASHMAP, obj, len));
         }
-        return scope.Escape(obj);
+        return obj;
     }
     case Type::FUNCTION: {
         ExternalFunction* efn = reader.ReadValue<ExternalFunction*>();
         RT_ASSERT(isolate->template_cache());
         v8::Local<v8::Value> fnobj { isolate->template_cache()->NewWrappedFunction(efn) };
-        return scope.Escape(fnobj);
+        objects.push_back(fnobj);
+        return fnobj;
+    }
+    case Type::MAP:
+    case Type::SET: {
+        uint32_t len = reader.ReadValue<uint32_t>();
+        bool is_map = Type::MAP == t;
+        v8::Local<v8::Function> ctor { GetGlobalConstructor(iv8, is_map ? "Map" : "Set") };
+        v8::Local<v8::Object> obj;
+        v8::Local<v8::Value> insert;
+        if (!ctor.IsEmpty()) {
+            obj = ctor->NewInstance();
+        }
+
+        if (!obj.IsEmpty()) {
+            insert = obj->Get(v8::String::NewFromUtf8(iv8, is_map ? "set" : "add"));
+        }
+
+        if (insert.IsEmpty() || !insert->IsFunction()) {
+            // Global Map or Set was replaced by user code. Report error
+            // and read entries into plain object to keep stream in sync
+            iv8->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(iv8,
+                is_map ? "Unable to unpack Map, global Map is not a constructor"
+                       : "Unable to unpack Set, global Set is not a constructor")));
+            obj = v8::Object::New(iv8);
+            insert = v8::Function::New(iv8, DiscardEntry);
+        }
+
+        objects.push_back(obj);
+        if (len > 0) {
+            stack.push_back(UnpackFrame(obj, v8::Local<v8::Function>::Cast(insert),
+                                        is_map, is_map ? len * 2 : len));
+        }
+        return obj;
+    }
+    case Type::DATE: {
+        v8::Local<v8::Value> date { v8::Date::New(iv8, reader.ReadValue<double>()) };
+        objects.push_back(date);
+        return date;
+    }
+    case Type::REGEXP: {
+        uint32_t flags = reader.ReadValue<uint32_t>();
+        v8::Local<v8::Value> source { UnpackValue(isolate, reader, objects, stack) };
+        RT_ASSERT(source->IsString());
+        v8::Local<v8::Value> re { v8::RegExp::New(source->ToString(),
+            static_cast<v8::RegExp::Flags>(flags)) };
+        objects.push_back(re);
+        return re;
+    }
+    case Type::BACKREF: {
+        uint32_t index = reader.ReadValue<uint32_t>();
+        RT_ASSERT(index < objects.size());
+        return objects[index];
     }
     default:
         RT_ASSERT(!"unknown data type");
@@ -331,7 +668,7 @@ v8::Local<v8::Value> TransportData::UnpackValue(Isolate* isolate, ByteStreamRead
     }
 
     RT_ASSERT(!"should not be here");
-    return scope.Escape<v8::Primitive>(v8::Undefined(iv8));
+    return v8::Undefined(iv8);
 }
 
 } // namespace rt
@@ -48,6 +48,37 @@ public:
         memcpy(p, &value, valsize);
     }
 
+    /**
+     * Append unsigned LEB128 value, 7 bits per byte with
+     * high bit set if more bytes follow
+     */
+    void AppendVarUint(uint32_t value) {
+        uint8_t buf[5];
+        uint32_t len = 0;
+        while (value >= 0x80) {
+            buf[len++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        buf[len++] = static_cast<uint8_t>(value);
+        memcpy(AppendBuffer(len), buf, len);
+    }
+
+    /**
+     * Append signed value as zigzag LEB128, small negative
+     * numbers take one byte too
+     */
+    void AppendVarInt(int32_t value) {
+        AppendVarUint(ZigZagEncode(value));
+    }
+
+    static uint32_t ZigZagEncode(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    static int32_t ZigZagDecode(uint32_t value) {
+        return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+    }
+
     /**
      * Clear stream
      */
@@ -55,6 +86,21 @@ public:
         data_.clear();
     }
 
+    /**
+     * Current stream size in bytes
+     */
+    size_t size() const {
+        return data_.size();
+    }
+
+    /**
+     * Drop everything appended after stream had provided size
+     */
+    void Truncate(size_t size) {
+        RT_ASSERT(size <= data_.size());
+        data_.resize(size);
+    }
+
     /**
      * Allocate uninitialized space on the stream. Returns pointer
      * to first element.
@@ -93,6 +139,30 @@ public:
         return ret;
     }
 
+    /**
+     * Read unsigned LEB128 value
+     */
+    uint32_t ReadVarUint() {
+        uint32_t value = 0;
+        for (uint32_t shift = 0; shift < 35; shift += 7) {
+            uint8_t byte = ReadValue<uint8_t>();
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (0 == (byte & 0x80)) {
+                return value;
+            }
+        }
+
+        RT_ASSERT(!"invalid varint");
+        return value;
+    }
+
+    /**
+     * Read signed zigzag LEB128 value
+     */
+    int32_t ReadVarInt() {
+        return ByteStream::ZigZagDecode(ReadVarUint());
+    }
+
     /**
      * Returns pointer to current stream position. Moves
      * read position "len" elements forward.
@@ -109,6 +179,53 @@ private:
     size_t pos_;
 };
 
+/**
+ * Objects seen by serializer. Every object gets an index in
+ * order of appearance in the stream, repeated references and
+ * cycles are encoded as BACKREF to that index. Objects are
+ * bucketed by identity hash and compared with operator==
+ */
+template<typename T>
+class IdentityTable {
+public:
+    IdentityTable() {}
+
+    /**
+     * Find index of previously added object, returns false
+     * if object is not in the table
+     */
+    bool Find(int hash, const T& obj, uint32_t* index) const {
+        RT_ASSERT(index);
+        auto range = ids_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (objects_[it->second] == obj) {
+                *index = it->second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Add(int hash, const T& obj) {
+        ids_.insert(std::make_pair(hash, static_cast<uint32_t>(objects_.size())));
+        objects_.push_back(obj);
+    }
+
+    /**
+     * Reserve index for container that is not a JS object
+     * (arguments list)
+     */
+    void AddPlaceholder() {
+        objects_.push_back(T());
+    }
+
+    uint32_t count() const { return objects_.size(); }
+private:
+    SharedSTLUnorderedMultimap<int, uint32_t> ids_;
+    SharedSTLVector<T> objects_;
+    DELETE_COPY_AND_ASSIGN(IdentityTable);
+};
+
 /**
  * Serialized data to be transferred between contexts or isolates
  */
@@ -116,7 +233,6 @@ class TransportData {
 public:
     enum class SerializeError {
         NONE,
-        MAX_STACK,
         INVALID_TYPE,
         EXTERNAL_BUFFER,
         TYPEDARRAY_VIEW,
@@ -192,12 +308,6 @@ public:
         switch (err) {
         case SerializeError::NONE:
             return false;
-        case SerializeError::MAX_STACK:
-            iv8->ThrowException(
-                v8::Exception::Error(
-                v8::String::NewFromUtf8(iv8,
-                "Maximum call stack size exceeded")));
-            return true;
         case SerializeError::INVALID_TYPE:
             iv8->ThrowException(
                 v8::Exception::Error(
@@ -208,7 +318,7 @@ public:
             iv8->ThrowException(
                 v8::Exception::Error(
                 v8::String::NewFromUtf8(iv8,
-                "ArrayBuffer have already transferred")));
+                "ArrayBuffer have already transferred or is pinned for DMA")));
             return true;
         case SerializeError::TYPEDARRAY_VIEW:
             iv8->ThrowException(
@@ -231,17 +341,86 @@ private:
         STRING_UTF8,
         STRING_REF,
         OBJECT_REF,
-        INT32,
-        UINT32,
-        DOUBLE,
+        INT32,          // Zigzag varint
+        UINT32,         // Varint, values above int32 range only
+        DOUBLE,         // Raw 8 bytes, keeps -0 and NaN
         BOOL_TRUE,
         BOOL_FALSE,
         ARRAYBUFFER,
         ARRAY,
         HASHMAP,
         FUNCTION,
+        BACKREF,
+        MAP,
+        SET,
+        DATE,
+        REGEXP,
+        INT32_ARRAY,    // Dense array of int32 values as zigzag varints
+    };
+
+    /**
+     * Type byte with this bit set is an integer 0..127 itself,
+     * no payload follows
+     */
+    static const uint8_t kSmallIntTag = 0x80;
+
+    void AppendInt32(int32_t value) {
+        if (value >= 0 && value < 0x80) {
+            stream_.AppendValue<uint8_t>(kSmallIntTag | static_cast<uint8_t>(value));
+            return;
+        }
+
+        AppendType(Type::INT32);
+        stream_.AppendVarInt(value);
+    }
+
+    bool AppendInt32Array(v8::Local<v8::Array> a, uint32_t len);
+
+    /**
+     * Container which elements are not serialized yet. Objects
+     * graph is walked using explicit stack, so nesting depth
+     * is limited by available memory only
+     */
+    enum class FrameKind : uint8_t {
+        ARRAY,      // Elements are obj[0..length)
+        HASHMAP,    // Key-value pairs, keys are in items array
+        LIST,       // Elements are in items array (Map and Set entries)
     };
 
+    struct SerializeFrame {
+        SerializeFrame(FrameKind kind_, v8::Local<v8::Object> obj_,
+                       v8::Local<v8::Array> items_, uint32_t length_)
+            :	kind(kind_), obj(obj_), items(items_), index(0), length(length_) {}
+        FrameKind kind;
+        v8::Local<v8::Object> obj;
+        v8::Local<v8::Array> items;
+        uint32_t index;
+        uint32_t length;
+    };
+
+    /**
+     * Container which elements are not deserialized yet. Map and
+     * Set elements are added using insert function, Map keys and
+     * values are read one per step
+     */
+    struct UnpackFrame {
+        UnpackFrame(FrameKind kind_, v8::Local<v8::Object> obj_, uint32_t length_)
+            :	kind(kind_), obj(obj_), is_map(false), index(0), length(length_) {}
+        UnpackFrame(v8::Local<v8::Object> obj_, v8::Local<v8::Function> insert_,
+                    bool is_map_, uint32_t length_)
+            :	kind(FrameKind::LIST), obj(obj_), insert(insert_),
+                is_map(is_map_), index(0), length(length_) {}
+        FrameKind kind;
+        v8::Local<v8::Object> obj;
+        v8::Local<v8::Function> insert;
+        v8::Local<v8::Value> key;
+        bool is_map;
+        uint32_t index;
+        uint32_t length;
+    };
+
+    typedef IdentityTable<v8::Local<v8::Object>> ObjectIdentityTable;
+
     void Clear() {
         isolate_ = nullptr;
         err_ = SerializeError::NONE;
@@ -249,12 +428,14 @@ private:
         stream_.Clear();
     }
 
-    SerializeError SerializeValue(Thread* exporter, v8::Local<v8::Value> value, uint32_t stack_level);
-    v8::Local<v8::Value> UnpackValue(Isolate* isolate, ByteStreamReader& reader) const;
-
-    Type ReadType(ByteStreamReader& reader) const {
-        return static_cast<Type>(reader.ReadValue<uint8_t>());
-    }
+    SerializeError Serialize(Thread* exporter, v8::Local<v8::Value> value,
+                             ObjectIdentityTable& table);
+    SerializeError SerializeValue(Thread* exporter, v8::Local<v8::Value> value,
+                                  ObjectIdentityTable& table,
+                                  SharedSTLVector<SerializeFrame>& stack);
+    v8::Local<v8::Value> UnpackValue(Isolate* isolate, ByteStreamReader& reader,
+                                     SharedSTLVector<v8::Local<v8::Value>>& objects,
+                                     SharedSTLVector<UnpackFrame>& stack) const;
 
     v8::Local<v8::Value> GetRef(v8::Isolate* iv8, uint32_t index) const;
     uint32_t AddRef(v8::Local<v8::Value> value);
@@ -263,8 +444,6 @@ private:
         stream_.AppendValue<uint8_t>(static_cast<uint8_t>(type));
     }
 
-    static const uint32_t kMaxStackSize = 128;
-
     Isolate* isolate_;
     bool allow_ref_;
     SerializeError err_;
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include <kernel/allocator.h>
 
 namespace rt {
@@ -22,4 +23,8 @@ namespace rt {
 template<typename T>
 using SharedSTLVector = std::vector<T, DefaultSTLAlloc<T>>;
 
+template<typename K, typename V>
+using SharedSTLUnorderedMultimap = std::unordered_multimap<K, V, std::hash<K>,
+    std::equal_to<K>, DefaultSTLAlloc<std::pair<const K, V>>>;
+
 } // namespace rt
@@ -14,7 +14,10 @@
 
 #include "acpi-x64.h"
 #include "local-apic-x64.h"
+#include "hpet-x64.h"
 #include <kernel/engines.h>
+#include <algorithm>
+#include <kernel/cpu.h>
 
 namespace rt {
 
@@ -49,9 +52,76 @@ struct AcpiHeaderMADT {
 enum class ApicType : uint8_t {
     LOCAL_APIC = 0,
     IO_APIC = 1,
-    INTERRUPT_OVERRIDE = 2
+    INTERRUPT_OVERRIDE = 2,
+    LOCAL_X2APIC = 9
 };
 
+struct AcpiHeaderHPET {
+    AcpiHeader header;
+    uint32_t eventTimerBlockId;
+    uint8_t addressSpaceId;
+    uint8_t registerBitWidth;
+    uint8_t registerBitOffset;
+    uint8_t accessSize;
+    uint64_t address;
+    uint8_t hpetNumber;
+    uint16_t minimumTick;
+    uint8_t pageProtection;
+} __attribute__((packed));
+
+struct AcpiHeaderSRAT {
+    AcpiHeader header;
+    uint32_t reserved1;
+    uint64_t reserved2;
+} __attribute__((packed));
+
+struct AcpiHeaderSLIT {
+    AcpiHeader header;
+    uint64_t localities;
+} __attribute__((packed));
+
+enum class SratType : uint8_t {
+    PROCESSOR_AFFINITY = 0,
+    MEMORY_AFFINITY = 1,
+    X2APIC_AFFINITY = 2
+};
+
+struct SratHeader {
+    SratType type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct SratProcessorAffinity {
+    SratHeader header;
+    uint8_t proximityDomainLow;
+    uint8_t apicId;
+    uint32_t flags;
+    uint8_t localSapicEid;
+    uint8_t proximityDomainHigh[3];
+    uint32_t clockDomain;
+} __attribute__((packed));
+
+struct SratMemoryAffinity {
+    SratHeader header;
+    uint32_t proximityDomain;
+    uint16_t reserved1;
+    uint64_t baseAddress;
+    uint64_t length;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint64_t reserved3;
+} __attribute__((packed));
+
+struct SratX2ApicAffinity {
+    SratHeader header;
+    uint16_t reserved1;
+    uint32_t proximityDomain;
+    uint32_t x2ApicId;
+    uint32_t flags;
+    uint32_t clockDomain;
+    uint32_t reserved2;
+} __attribute__((packed));
+
 struct ApicHeader {
     ApicType type;
     uint8_t length;
@@ -64,6 +134,14 @@ struct ApicLocalApic {
     uint32_t flags;
 } __attribute__((packed));
 
+struct ApicLocalX2Apic {
+    ApicHeader header;
+    uint16_t reserved;
+    uint32_t x2ApicId;
+    uint32_t flags;
+    uint32_t acpiProcessorUid;
+} __attribute__((packed));
+
 struct ApicIoApic {
     ApicHeader header;
     uint8_t ioApicId;
@@ -87,6 +165,17 @@ void AcpiX64::Init() {
         printf("Unable to find IO APIC to setup interrupts.\n");
         abort();
     }
+
+    if (nullptr != hpet_) {
+        hpet_->Init();
+    }
+
+    topology_.Detect();
+    PrintTopology();
+    InitNuma();
+
+    // Slots are filled by CPUs themselves during init
+    cpu_apic_ids_.resize(cpu_count_ > 0 ? cpu_count_ : 1, 0);
 }
 
 bool AcpiX64::ParseRSDP(void* p) {
@@ -142,11 +231,133 @@ void AcpiX64::ParseDT(AcpiHeader* ptr) {
     case TableUint32("APIC"):
         ParseTableAPIC(reinterpret_cast<AcpiHeaderMADT*>(ptr));
         break;
+    case TableUint32("HPET"):
+        ParseTableHPET(reinterpret_cast<AcpiHeaderHPET*>(ptr));
+        break;
+    case TableUint32("SRAT"):
+        ParseTableSRAT(reinterpret_cast<AcpiHeaderSRAT*>(ptr));
+        break;
+    case TableUint32("SLIT"):
+        slit_ = reinterpret_cast<AcpiHeaderSLIT*>(ptr);
+        break;
     default:
         break;
     }
 }
 
+void AcpiX64::ParseTableHPET(AcpiHeaderHPET* header) {
+    RT_ASSERT(header);
+
+    // Only first memory mapped block is used
+    if (nullptr != hpet_ || 0 != header->addressSpaceId || 0 == header->address) {
+        return;
+    }
+
+    hpet_ = new HpetX64(reinterpret_cast<void*>(header->address),
+                        header->minimumTick);
+}
+
+uint32_t AcpiX64::NumaNodeOfDomain(uint32_t domain) {
+    for (uint32_t i = 0; i < numa_domains_.size(); ++i) {
+        if (domain == numa_domains_[i]) {
+            return i;
+        }
+    }
+
+    // Extra domains are merged into the first node
+    if (numa_domains_.size() >= PhysicalAllocator::kMaxNodes) {
+        return 0;
+    }
+
+    numa_domains_.push_back(domain);
+    return numa_domains_.size() - 1;
+}
+
+void AcpiX64::ParseTableSRAT(AcpiHeaderSRAT* header) {
+    RT_ASSERT(header);
+
+    uint8_t* p = (uint8_t*)(header + 1);
+    uint8_t* end = (uint8_t*)header + header->header.length;
+
+    while (p < end) {
+        SratHeader* entry = (SratHeader*)p;
+        if (0 == entry->length) {
+            break;
+        }
+
+        switch (entry->type) {
+        case SratType::PROCESSOR_AFFINITY: {
+            SratProcessorAffinity* s = (SratProcessorAffinity*)p;
+            if (0 == (s->flags & 1)) {
+                break;
+            }
+            uint32_t domain = s->proximityDomainLow
+                | (static_cast<uint32_t>(s->proximityDomainHigh[0]) << 8)
+                | (static_cast<uint32_t>(s->proximityDomainHigh[1]) << 16)
+                | (static_cast<uint32_t>(s->proximityDomainHigh[2]) << 24);
+            numa_cpus_.push_back({s->apicId, NumaNodeOfDomain(domain)});
+        }
+        break;
+        case SratType::X2APIC_AFFINITY: {
+            SratX2ApicAffinity* s = (SratX2ApicAffinity*)p;
+            if (0 == (s->flags & 1)) {
+                break;
+            }
+            numa_cpus_.push_back({s->x2ApicId, NumaNodeOfDomain(s->proximityDomain)});
+        }
+        break;
+        case SratType::MEMORY_AFFINITY: {
+            SratMemoryAffinity* s = (SratMemoryAffinity*)p;
+            if (0 == (s->flags & 1) || 0 == s->length) {
+                break;
+            }
+            // Skip hot-pluggable (bit 1) and non-volatile (bit 2)
+            // ranges, they are not usable as regular RAM
+            if (0 != (s->flags & ((1 << 1) | (1 << 2)))) {
+                break;
+            }
+            if (numa_ranges_.size() >= PhysicalAllocator::kMaxRanges) {
+                break;
+            }
+            numa_ranges_.push_back({s->baseAddress, s->length,
+                                    NumaNodeOfDomain(s->proximityDomain)});
+        }
+        break;
+        default:
+            break;
+        }
+
+        p += entry->length;
+    }
+}
+
+void AcpiX64::InitNuma() {
+    uint32_t nodes_count = numa_domains_.size();
+    if (nodes_count < 2 || numa_ranges_.empty()) {
+        return;
+    }
+
+    // Default distances are used when SLIT is missing or
+    // doesn't describe the domain
+    std::vector<uint8_t> distances(nodes_count * nodes_count);
+    for (uint32_t i = 0; i < nodes_count; ++i) {
+        for (uint32_t j = 0; j < nodes_count; ++j) {
+            uint8_t distance = (i == j) ? kLocalDistance : kRemoteDistance;
+            uint64_t from = numa_domains_[i];
+            uint64_t to = numa_domains_[j];
+            if (nullptr != slit_ && from < slit_->localities && to < slit_->localities) {
+                const uint8_t* matrix = reinterpret_cast<const uint8_t*>(slit_ + 1);
+                distance = matrix[from * slit_->localities + to];
+            }
+            distances[i * nodes_count + j] = distance;
+        }
+    }
+
+    printf("NUMA: %d nodes, %d memory ranges\n", nodes_count, numa_ranges_.size());
+    GLOBAL_mem_manager()->SetNumaLayout(numa_ranges_.data(), numa_ranges_.size(),
+                                        nodes_count, distances.data());
+}
+
 void AcpiX64::ParseTableAPIC(AcpiHeaderMADT* header) {
     RT_ASSERT(header);
     RT_ASSERT(header->localApicAddr);
@@ -176,6 +387,22 @@ void AcpiX64::ParseTableAPIC(AcpiHeaderMADT* header) {
             ++cpu_count_;
         }
         break;
+        case ApicType::LOCAL_X2APIC: {
+            // Processors with APIC ID above 254 are listed here,
+            // these are only reachable in x2APIC mode
+            ApicLocalX2Apic* s = (ApicLocalX2Apic*)p;
+            if (!local_apic_->is_x2apic()) {
+                madt_complete_ = false;
+                break;
+            }
+            AcpiCPU cpu;
+            cpu.cpu_id = s->acpiProcessorUid;
+            cpu.local_apic_id = s->x2ApicId;
+            cpu.enabled = (1 == (s->flags & 1));
+            cpus_.push_back(cpu);
+            ++cpu_count_;
+        }
+        break;
         case ApicType::IO_APIC: {
             ApicIoApic* s = (ApicIoApic*)p;
             io_apics_.push_back(new IoApicX64(s->ioApicId,
@@ -193,6 +420,107 @@ void AcpiX64::ParseTableAPIC(AcpiHeaderMADT* header) {
     }
 }
 
+void AcpiX64::PrintTopology() const {
+    std::vector<uint32_t> packages;
+    std::vector<uint64_t> cores;
+    uint32_t threads = 0;
+
+    for (const AcpiCPU& cpu : cpus_) {
+        if (!cpu.enabled) {
+            continue;
+        }
+
+        CpuTopology t = topology_.Decode(cpu.local_apic_id);
+        uint64_t core = (static_cast<uint64_t>(t.package_id) << 32) | t.core_id;
+        if (std::find(packages.begin(), packages.end(), t.package_id) == packages.end()) {
+            packages.push_back(t.package_id);
+        }
+        if (std::find(cores.begin(), cores.end(), core) == cores.end()) {
+            cores.push_back(core);
+        }
+        ++threads;
+    }
+
+    printf("CPU topology: %d packages, %d cores, %d threads\n",
+           static_cast<uint32_t>(packages.size()),
+           static_cast<uint32_t>(cores.size()), threads);
+}
+
+void AcpiX64::Delay(uint64_t microseconds) const {
+    if (nullptr != hpet_) {
+        hpet_->Delay(microseconds);
+        return;
+    }
+
+    RT_ASSERT(local_apic_);
+    uint64_t tsc_freq = local_apic_->tsc_frequency();
+    RT_ASSERT(tsc_freq);
+
+    uint64_t end = CpuPlatform::ReadTSC() + tsc_freq / 1000000 * microseconds;
+    while (CpuPlatform::ReadTSC() < end) {
+        Cpu::WaitPause();
+    }
+}
+
+void AcpiX64::RegisterCurrentCPU() {
+    RT_ASSERT(local_apic_);
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < cpu_apic_ids_.size());
+    uint32_t apic_id = local_apic_->Id();
+    cpu_apic_ids_[cpu] = apic_id;
+
+    for (const AcpiCpuNode& cpu_node : numa_cpus_) {
+        if (apic_id == cpu_node.local_apic_id) {
+            GLOBAL_mem_manager()->SetCpuNode(cpu, cpu_node.node);
+            break;
+        }
+    }
+}
+
+bool AcpiX64::CanBroadcastStartup() const {
+    // Broadcast reaches every CPU in the system, including
+    // disabled ones and ones not listed in cpus_
+    if (!madt_complete_) {
+        return false;
+    }
+
+    for (const AcpiCPU& cpu : cpus_) {
+        if (!cpu.enabled) {
+            return false;
+        }
+    }
+
+    // Each package should have exactly as many MADT entries
+    // as CPUID enumerates
+    uint32_t package_cpus = topology_.package_cpus();
+    if (0 == package_cpus) {
+        return false;
+    }
+
+    std::vector<uint32_t> packages;
+    for (const AcpiCPU& cpu : cpus_) {
+        uint32_t package = topology_.Decode(cpu.local_apic_id).package_id;
+        if (std::find(packages.begin(), packages.end(), package) == packages.end()) {
+            packages.push_back(package);
+        }
+    }
+
+    for (uint32_t package : packages) {
+        uint32_t count = 0;
+        for (const AcpiCPU& cpu : cpus_) {
+            if (topology_.Decode(cpu.local_apic_id).package_id == package) {
+                ++count;
+            }
+        }
+
+        if (count != package_cpus) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void AcpiX64::StartCPUs() {
     CpuTrampolineX64 trampoline;
     uint8_t startup_vec = 0x08;
@@ -200,36 +528,91 @@ void AcpiX64::StartCPUs() {
     RT_ASSERT(0 == trampoline.cpus_counter_value());
 
     uint32_t bsp_apic_id = local_apic_->Id();
-    uint16_t cpus_started = 0;
+    uint16_t cpus_expected = 0;
     for (const AcpiCPU& cpu : cpus_) {
-        if (cpu.local_apic_id == bsp_apic_id) {
-            continue;
+        if (cpu.local_apic_id != bsp_apic_id && cpu.enabled) {
+            ++cpus_expected;
         }
-        local_apic_->SendApicInit(cpu.local_apic_id);
     }
 
-    GLOBAL_engines()->NonIsolateSleep(50);
+    if (0 == cpus_expected) {
+        return;
+    }
 
-    for (const AcpiCPU& cpu : cpus_) {
-        if (cpu.local_apic_id == bsp_apic_id) {
-            continue;
+    uint64_t tsc_start = CpuPlatform::ReadTSC();
+
+    // Broadcast would also wake CPUs disabled by firmware or
+    // skipped by MADT parser, address them one by one in this case
+    bool broadcast = CanBroadcastStartup();
+
+    if (broadcast) {
+        local_apic_->SendApicInitAll();
+    } else {
+        for (const AcpiCPU& cpu : cpus_) {
+            if (cpu.local_apic_id != bsp_apic_id && cpu.enabled) {
+                local_apic_->SendApicInit(cpu.local_apic_id);
+            }
+        }
+    }
+
+    Delay(kInitDelayMicroseconds);
+
+    // Second STARTUP is ignored by CPUs already running
+    for (uint32_t i = 0; i < 2; ++i) {
+        if (broadcast) {
+            local_apic_->SendApicStartupAll(startup_vec);
+        } else {
+            for (const AcpiCPU& cpu : cpus_) {
+                if (cpu.local_apic_id != bsp_apic_id && cpu.enabled) {
+                    local_apic_->SendApicStartup(cpu.local_apic_id, startup_vec);
+                }
+            }
         }
-        local_apic_->SendApicStartup(cpu.local_apic_id, startup_vec);
-        ++cpus_started;
 
-        printf("Starting #%d...\n", cpus_started);
-        while (trampoline.cpus_counter_value() != cpus_started) {
-            rt::Cpu::WaitPause();
+        Delay(kStartupDelayMicroseconds);
+        if (trampoline.cpus_counter_value() == cpus_expected) {
+            break;
+        }
+    }
+
+    // All APs initialize concurrently, wait for them once
+    uint64_t tsc_freq = local_apic_->tsc_frequency();
+    uint64_t deadline = CpuPlatform::ReadTSC() + tsc_freq / 1000000 * kStartupTimeoutMicroseconds;
+    while (trampoline.cpus_counter_value() != cpus_expected) {
+        if (CpuPlatform::ReadTSC() > deadline) {
+            break;
         }
+        Cpu::WaitPause();
     }
 
-    printf("Cpus: done.\n");
+    uint64_t elapsed_us = (CpuPlatform::ReadTSC() - tsc_start) / (tsc_freq / 1000000);
+    printf("Cpus: %d of %d started in %d us.\n", trampoline.cpus_counter_value(),
+           cpus_expected, static_cast<uint32_t>(elapsed_us));
 }
 
 void AcpiX64::InitIoApics() {
     for (IoApicX64* ioa : io_apics_) {
         ioa->Init();
     }
+
+    if (nullptr == hpet_) {
+        return;
+    }
+
+    // HPET routes comparators to inputs of IO APIC which
+    // handles GSI 0
+    for (IoApicX64* ioa : io_apics_) {
+        if (0 != ioa->interrupt_base()) {
+            continue;
+        }
+
+        int32_t irq = hpet_->RouteOneShot(ioa->irq_count());
+        if (irq >= 0) {
+            ioa->RouteIrq(irq);
+            printf("HPET: one-shot comparator on IRQ %d\n", irq);
+        }
+        break;
+    }
 }
 
 } // namespace rt
@@ -20,12 +20,18 @@
 #include <vector>
 #include <kernel/x64/cpu-trampoline-x64.h>
 #include <kernel/x64/ioapic-x64.h>
+#include <kernel/x64/cpu-topology-x64.h>
+#include <kernel/mem-manager.h>
 
 namespace rt {
 
 struct AcpiHeader;
 struct AcpiHeaderMADT;
+struct AcpiHeaderHPET;
+struct AcpiHeaderSRAT;
+struct AcpiHeaderSLIT;
 class LocalApicX64;
+class HpetX64;
 
 struct AcpiCPU {
     uint32_t cpu_id;
@@ -33,12 +39,23 @@ struct AcpiCPU {
     bool enabled;
 };
 
+/**
+ * NUMA node of CPU from SRAT
+ */
+struct AcpiCpuNode {
+    uint32_t local_apic_id;
+    uint32_t node;
+};
+
 class AcpiX64 {
 public:
     AcpiX64()
         :	local_apic_(nullptr),
             local_apic_address_(nullptr),
-            cpu_count_(0) {
+            hpet_(nullptr),
+            slit_(nullptr),
+            cpu_count_(0),
+            madt_complete_(true) {
         cpus_.reserve(12);
         Init();
         RT_ASSERT(local_apic_);
@@ -46,22 +63,73 @@ public:
 
     LocalApicX64* local_apic() const { return local_apic_; }
     void* local_apic_address() const { return local_apic_address_; }
+
+    /**
+     * Get package, core and thread of CPU by its index. CPU
+     * should be started already
+     */
+    CpuTopology cpu_topology(uint32_t cpu) const {
+        return topology_.Decode(cpu_apic_id(cpu));
+    }
+
+    /**
+     * Returns HPET or nullptr if it's not available
+     */
+    HpetX64* hpet() const { return hpet_; }
     uint32_t cpus_count() const { return cpu_count_; }
 
+    /**
+     * Get local apic ID of CPU by its index
+     */
+    uint32_t cpu_apic_id(uint32_t cpu) const {
+        RT_ASSERT(cpu < cpu_apic_ids_.size());
+        return cpu_apic_ids_[cpu];
+    }
+
+    /**
+     * Program IO APICs and route HPET one-shot comparator
+     */
     void InitIoApics();
     void StartCPUs();
+
+    /**
+     * Save local apic ID of current CPU, required to send
+     * interrupts to it by index
+     */
+    void RegisterCurrentCPU();
 private:
+    static const uint64_t kInitDelayMicroseconds = 10000;
+    static const uint64_t kStartupDelayMicroseconds = 200;
+    static const uint64_t kStartupTimeoutMicroseconds = 1000000;
+    static const uint8_t kLocalDistance = 10;
+    static const uint8_t kRemoteDistance = 20;
+
     LocalApicX64* local_apic_;
     void* local_apic_address_;
+    HpetX64* hpet_;
+    CpuTopologyX64 topology_;
     std::vector<AcpiCPU> cpus_;
+    std::vector<uint32_t> cpu_apic_ids_;
     std::vector<IoApicX64*> io_apics_;
+    std::vector<uint32_t> numa_domains_;    // Proximity domain of each node
+    std::vector<NumaMemoryRange> numa_ranges_;
+    std::vector<AcpiCpuNode> numa_cpus_;
+    AcpiHeaderSLIT* slit_;
     uint32_t cpu_count_;
+    bool madt_complete_;        // All MADT processor entries are in cpus_
 
     void Init();
     bool ParseRSDP(void* p);
     void ParseRSDT(AcpiHeader* ptr);
     void ParseDT(AcpiHeader* ptr);
     void ParseTableAPIC(AcpiHeaderMADT* header);
+    void ParseTableHPET(AcpiHeaderHPET* header);
+    void ParseTableSRAT(AcpiHeaderSRAT* header);
+    uint32_t NumaNodeOfDomain(uint32_t domain);
+    void InitNuma();
+    void Delay(uint64_t microseconds) const;
+    void PrintTopology() const;
+    bool CanBroadcastStartup() const;
     DELETE_COPY_AND_ASSIGN(AcpiX64);
 };
 
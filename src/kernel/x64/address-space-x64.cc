@@ -15,6 +15,7 @@
 #include "address-space-x64.h"
 #include <stdio.h>
 #include <kernel/mem-manager.h>
+#include <kernel/platform.h>
 
 namespace rt {
 
@@ -67,93 +68,187 @@ void AddressSpaceX64::MapPage(void* virtaddr, void* physaddr, bool invalidate, b
     RT_ASSERT(pdp_offset < 512);
     RT_ASSERT(pml4_offset < 512);
 
-    physaddr = PhysicalAllocator::PageAligned(physaddr);
-    RT_ASSERT(cr3_.PageDirectory);
-    PageTable<PML4Entry>* pml4_table =
-        reinterpret_cast<PageTable<PML4Entry>*>(cr3_.PageDirectory);
-    RT_ASSERT(pml4_table);
-    PageTable<PDPEntry>* pdp_table = nullptr;
-    PageTable<PDEntry>* pd_table = nullptr;
-
-    bool create_pde = false;
-    bool create_pdpe = false;
-    bool create_pml4e = false;
-
-    PML4Entry pml4 = pml4_table->GetEntry(pml4_offset);
-    if (pml4.IsPresent) {
-        RT_ASSERT(pml4.PageDirectory);
-        pdp_table = reinterpret_cast<PageTable<PDPEntry>*>(pml4.PageDirectory);
-
-        PDPEntry pdp = pdp_table->GetEntry(pdp_offset);
-        if (pdp.IsPresent) {
-            RT_ASSERT(pdp.PageDirectory);
-            pd_table = reinterpret_cast<PageTable<PDEntry>*>(pdp.PageDirectory);
-
-            PDEntry pd = pd_table->GetEntry(pd_offset);
-            if (pd.IsPresent) {
-                void* page_addr = pd.PageAddress;
-                if (physaddr == page_addr) {
-                    return;
+    bool remap = false;
+
+    // Lock is released before shootdown, other CPUs could
+    // wait for it with interrupts disabled
+    {	ScopedLock lock(map_page_locker_);
+        physaddr = PhysicalAllocator::PageAligned(physaddr);
+        RT_ASSERT(cr3_.PageDirectory);
+        PageTable<PML4Entry>* pml4_table =
+            reinterpret_cast<PageTable<PML4Entry>*>(cr3_.PageDirectory);
+        RT_ASSERT(pml4_table);
+        PageTable<PDPEntry>* pdp_table = nullptr;
+        PageTable<PDEntry>* pd_table = nullptr;
+
+        bool create_pde = false;
+        bool create_pdpe = false;
+        bool create_pml4e = false;
+
+        PML4Entry pml4 = pml4_table->GetEntry(pml4_offset);
+        if (pml4.IsPresent) {
+            RT_ASSERT(pml4.PageDirectory);
+            pdp_table = reinterpret_cast<PageTable<PDPEntry>*>(pml4.PageDirectory);
+
+            PDPEntry pdp = pdp_table->GetEntry(pdp_offset);
+            if (pdp.IsPresent) {
+                RT_ASSERT(pdp.PageDirectory);
+                pd_table = reinterpret_cast<PageTable<PDEntry>*>(pdp.PageDirectory);
+
+                PDEntry pd = pd_table->GetEntry(pd_offset);
+                if (pd.IsPresent) {
+                    void* page_addr = pd.PageAddress;
+                    if (physaddr == page_addr) {
+                        return;
+                    }
+
+                    // Device could still access old address
+                    RT_ASSERT(!pd.IsPinned && "remapping pinned page");
+
+                    create_pde = true;
+                    remap = true;
+                } else {
+                    create_pde = true;
                 }
             } else {
                 create_pde = true;
+                create_pdpe = true;
             }
         } else {
             create_pde = true;
             create_pdpe = true;
+            create_pml4e = true;
         }
-    } else {
-        create_pde = true;
-        create_pdpe = true;
-        create_pml4e = true;
-    }
 
-    if (create_pde) {
-        PDEntry pd;
-        pd.IsPresent = true;
-        pd.IsWriteable = true;
-        pd.IsWriteThrough = writethrough;
-        pd.IsPageSize = true;
-        pd.IsGlobal = false;
-        pd.PageAddress = physaddr;
-
-        if (nullptr == pd_table) {
-            pd_table = table_allocator_->AllocTable<PDEntry>();
-            RT_ASSERT(pd_table);
+        if (create_pde) {
+            PDEntry pd;
+            pd.IsPresent = true;
+            pd.IsWriteable = true;
+            pd.IsWriteThrough = writethrough;
+            pd.IsPageSize = true;
+            pd.IsGlobal = false;
+            pd.PageAddress = physaddr;
+
+            if (nullptr == pd_table) {
+                pd_table = table_allocator_->AllocTable<PDEntry>();
+                RT_ASSERT(pd_table);
+            }
+
+            pd_table->SetEntry(pd_offset, pd);
         }
 
-        pd_table->SetEntry(pd_offset, pd);
-    }
+        if (create_pdpe) {
+            PDPEntry pdp;
+            pdp.IsPresent = true;
+            pdp.IsWriteable = true;
+            pdp.IsWriteThrough = false;
+            RT_ASSERT(pd_table);
+            pdp.PageDirectory = pd_table;
+
+            if (nullptr == pdp_table) {
+                pdp_table = table_allocator_->AllocTable<PDPEntry>();
+                RT_ASSERT(pdp_table);
+            }
 
-    if (create_pdpe) {
-        PDPEntry pdp;
-        pdp.IsPresent = true;
-        pdp.IsWriteable = true;
-        pdp.IsWriteThrough = false;
-        RT_ASSERT(pd_table);
-        pdp.PageDirectory = pd_table;
+            pdp_table->SetEntry(pdp_offset, pdp);
+        }
 
-        if (nullptr == pdp_table) {
-            pdp_table = table_allocator_->AllocTable<PDPEntry>();
+        if (create_pml4e) {
+            PML4Entry pml4;
+            pml4.IsPresent = true;
+            pml4.IsWriteable = true;
+            pml4.IsWriteThrough = false;
             RT_ASSERT(pdp_table);
+            pml4.PageDirectory = pdp_table;
+            pml4_table->SetEntry(pml4_offset, pml4);
         }
+    }
 
-        pdp_table->SetEntry(pdp_offset, pdp);
+    if (!invalidate) {
+        return;
     }
 
-    if (create_pml4e) {
-        PML4Entry pml4;
-        pml4.IsPresent = true;
-        pml4.IsWriteable = true;
-        pml4.IsWriteThrough = false;
-        RT_ASSERT(pdp_table);
-        pml4.PageDirectory = pdp_table;
-        pml4_table->SetEntry(pml4_offset, pml4);
+    // Other CPUs could have cached old translation, non-present
+    // entries are never cached so new mappings are flushed locally
+    if (remap && nullptr != GLOBAL_platform()) {
+        TlbFlushBatch batch;
+        batch.Add(virtaddr);
+        batch.Flush(true);
+        return;
     }
 
-    if (invalidate) {
-        asm volatile("invlpg (%0)" ::"r" (virtaddr) : "memory");
+    InvalidatePage(virtaddr);
+}
+
+PageTable<PDEntry>* AddressSpaceX64::GetPageDirectory(void* virtaddr) {
+    uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtaddr);
+    uint32_t pdp_offset = (vaddr >> 30) & 0x1FF;
+    uint32_t pml4_offset = (vaddr >> 39) & 0x1FF;
+
+    RT_ASSERT(cr3_.PageDirectory);
+    PageTable<PML4Entry>* pml4_table =
+        reinterpret_cast<PageTable<PML4Entry>*>(cr3_.PageDirectory);
+
+    PML4Entry pml4 = pml4_table->GetEntry(pml4_offset);
+    if (!pml4.IsPresent) {
+        return nullptr;
     }
+
+    PageTable<PDPEntry>* pdp_table =
+        reinterpret_cast<PageTable<PDPEntry>*>(pml4.PageDirectory);
+    PDPEntry pdp = pdp_table->GetEntry(pdp_offset);
+    if (!pdp.IsPresent) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<PageTable<PDEntry>*>(pdp.PageDirectory);
+}
+
+void* AddressSpaceX64::VirtualToPhysical(void* virtaddr) {
+    uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtaddr);
+    uint32_t page_offset = vaddr & 0x1FFFFF;
+    uint32_t pd_offset = (vaddr >> 21) & 0x1FF;
+
+    PageTable<PDEntry>* pd_table = GetPageDirectory(virtaddr);
+    if (nullptr == pd_table) {
+        return nullptr;
+    }
+
+    PDEntry pd = pd_table->GetEntry(pd_offset);
+    if (!pd.IsPresent) {
+        return nullptr;
+    }
+
+    RT_ASSERT(pd.IsPageSize);
+    return reinterpret_cast<uint8_t*>(pd.PageAddress) + page_offset;
+}
+
+void* AddressSpaceX64::PinPage(void* virtaddr) {
+    uintptr_t vaddr = reinterpret_cast<uintptr_t>(virtaddr);
+    uint32_t page_offset = vaddr & 0x1FFFFF;
+    uint32_t pd_offset = (vaddr >> 21) & 0x1FF;
+
+    NoInterrupsScope no_interrupts;
+    ScopedLock lock(map_page_locker_);
+
+    PageTable<PDEntry>* pd_table = GetPageDirectory(virtaddr);
+    if (nullptr == pd_table) {
+        return nullptr;
+    }
+
+    PDEntry pd = pd_table->GetEntry(pd_offset);
+    if (!pd.IsPresent) {
+        return nullptr;
+    }
+
+    RT_ASSERT(pd.IsPageSize);
+    if (!pd.IsPinned) {
+        // Software bit, no TLB flush required
+        pd.IsPinned = true;
+        pd_table->SetEntry(pd_offset, pd);
+    }
+
+    return reinterpret_cast<uint8_t*>(pd.PageAddress) + page_offset;
 }
 
 } // namespace rt
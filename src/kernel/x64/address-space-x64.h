@@ -111,6 +111,7 @@ public:
     bool IsDirty; 			// D
     bool IsPageSize; 		// PS, 1 for 2MB
     bool IsGlobal; 			// G
+    bool IsPinned; 			// Available bit 9, physical address given to device
     bool IsNoExecute; 		// NX
     void* PageAddress;
 
@@ -124,6 +125,7 @@ public:
             IsDirty(false),
             IsPageSize(false),
             IsGlobal(false),
+            IsPinned(false),
             IsNoExecute(false),
             PageAddress(nullptr) { }
 
@@ -137,6 +139,7 @@ public:
             IsDirty(entry & (1UL << 6)),
             IsPageSize(entry & (1UL << 7)),
             IsGlobal(entry & (1UL << 8)),
+            IsPinned(entry & (1UL << 9)),
             IsNoExecute(entry & (1UL << 63)),
             PageAddress(reinterpret_cast<void*>(entry & 0xFFFFFFFE00000)) { }
 
@@ -151,6 +154,7 @@ public:
                 (static_cast<uint64_t>(IsDirty) << 6) |
                 (static_cast<uint64_t>(IsPageSize) << 7) |
                 (static_cast<uint64_t>(IsGlobal) << 8) |
+                (static_cast<uint64_t>(IsPinned) << 9) |
                 (static_cast<uint64_t>(IsNoExecute) << 63) |
                 (reinterpret_cast<uint64_t>(PageAddress)));
     }
@@ -197,6 +201,34 @@ public:
     void Configure();
     void MapPage(void* virtaddr, void* physaddr, bool invalidate, bool writethrough);
 
+    /**
+     * Get physical address mapped to virtual address, returns
+     * nullptr if page is not present
+     */
+    void* VirtualToPhysical(void* virtaddr);
+
+    /**
+     * Get physical address of mapped page and mark it pinned,
+     * MapPage never moves pinned page to another address
+     */
+    void* PinPage(void* virtaddr);
+
+    /**
+     * Invalidate TLB entry for single page on current CPU
+     */
+    inline static void InvalidatePage(void* virtaddr) {
+        asm volatile("invlpg (%0)" ::"r" (virtaddr) : "memory");
+    }
+
+    /**
+     * Flush all non-global TLB entries on current CPU
+     */
+    inline static void InvalidateAll() {
+        uint64_t cr3value;
+        asm volatile("mov %%cr3, %0" : "=r"(cr3value));
+        asm volatile("mov %0, %%cr3" :: "r"(cr3value) : "memory");
+    }
+
     inline static CR3Entry current() {
         uint64_t cr3value;
         asm volatile("mov %%cr3, %0" : "=r"(cr3value));
@@ -204,6 +236,12 @@ public:
         return CR3Entry(cr3value);
     }
 private:
+    /**
+     * Page directory that maps provided address, returns
+     * nullptr if there is none
+     */
+    PageTable<PDEntry>* GetPageDirectory(void* virtaddr);
+
     PageTableAllocator* table_allocator_;
     CR3Entry cr3_;
     PageTable<PML4Entry>* pml4_table_;
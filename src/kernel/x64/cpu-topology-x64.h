@@ -0,0 +1,174 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <kernel/x64/cpu-x64.h>
+
+namespace rt {
+
+/**
+ * Location of logical CPU in package / core / SMT thread hierarchy
+ */
+struct CpuTopology {
+    uint32_t package_id;
+    uint32_t core_id;
+    uint32_t thread_id;
+};
+
+/**
+ * Splits APIC ID into topology levels. Field widths are the same
+ * for all CPUs in the system, so they are read once on BSP and
+ * applied to MADT APIC IDs
+ */
+class CpuTopologyX64 {
+public:
+    CpuTopologyX64()
+        :	smt_shift_(0),
+            package_shift_(0),
+            package_cpus_(0) {}
+
+    /**
+     * Read APIC ID layout from CPUID of current CPU
+     */
+    void Detect() {
+        uint32_t eax, ebx, ecx, edx;
+        CpuPlatform::Cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+        uint32_t max_leaf = eax;
+
+        // V2 extended topology (0x1F) also reports module
+        // and die levels, prefer it over 0x0B
+        if (max_leaf >= kCpuidTopologyV2 && DetectExtended(kCpuidTopologyV2)) {
+            return;
+        }
+
+        if (max_leaf >= kCpuidTopology && DetectExtended(kCpuidTopology)) {
+            return;
+        }
+
+        DetectLegacy(max_leaf);
+    }
+
+    /**
+     * Get topology of CPU by its APIC ID
+     */
+    CpuTopology Decode(uint32_t apic_id) const {
+        CpuTopology topology;
+        topology.thread_id = apic_id & Mask(smt_shift_);
+        topology.core_id = (apic_id >> smt_shift_) & Mask(package_shift_ - smt_shift_);
+        topology.package_id = package_shift_ >= 32 ? 0 : apic_id >> package_shift_;
+        return topology;
+    }
+
+    uint32_t smt_shift() const { return smt_shift_; }
+    uint32_t package_shift() const { return package_shift_; }
+
+    /**
+     * Number of logical CPUs in package enumerated by CPUID
+     * extended topology leaf, 0 if it's not known
+     */
+    uint32_t package_cpus() const { return package_cpus_; }
+
+private:
+    static const uint32_t kCpuidTopology = 0x0b;
+    static const uint32_t kCpuidTopologyV2 = 0x1f;
+    static const uint32_t kLevelTypeSmt = 1;
+    static const uint32_t kMaxLevels = 8;
+    static const uint32_t kCpuidExtendedBase = 0x80000000;
+    static const uint32_t kCpuidAmdSize = 0x80000008;
+
+    uint32_t smt_shift_;
+    uint32_t package_shift_;
+    uint32_t package_cpus_;
+
+    static uint32_t Mask(uint32_t bits) {
+        return bits >= 32 ? 0xffffffff : (1U << bits) - 1;
+    }
+
+    static uint32_t CountBits(uint32_t count) {
+        uint32_t bits = 0;
+        while ((1U << bits) < count) {
+            ++bits;
+        }
+        return bits;
+    }
+
+    static bool IsVendorAmd() {
+        uint32_t eax, ebx, ecx, edx;
+        CpuPlatform::Cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+        // "AuthenticAMD"
+        return 0x68747541 == ebx && 0x69746e65 == edx && 0x444d4163 == ecx;
+    }
+
+    bool DetectExtended(uint32_t leaf) {
+        uint32_t eax, ebx, ecx, edx;
+        CpuPlatform::Cpuid(leaf, 0, &eax, &ebx, &ecx, &edx);
+        if (0 == ebx) {
+            return false;
+        }
+
+        // Shift of the last valid level gives package ID
+        for (uint32_t level = 0; level < kMaxLevels; ++level) {
+            CpuPlatform::Cpuid(leaf, level, &eax, &ebx, &ecx, &edx);
+            uint32_t type = (ecx >> 8) & 0xff;
+            if (0 == type) {
+                break;
+            }
+
+            uint32_t shift = eax & 0x1f;
+            if (kLevelTypeSmt == type) {
+                smt_shift_ = shift;
+            }
+            package_shift_ = shift;
+            package_cpus_ = ebx & 0xffff;
+        }
+
+        return true;
+    }
+
+    void DetectLegacy(uint32_t max_leaf) {
+        uint32_t eax, ebx, ecx, edx;
+        CpuPlatform::Cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+        // No HTT flag means single logical CPU per package
+        if (0 == (edx & (1 << 28))) {
+            smt_shift_ = 0;
+            package_shift_ = 0;
+            return;
+        }
+
+        uint32_t logical_count = (ebx >> 16) & 0xff;
+        package_shift_ = CountBits(logical_count);
+
+        uint32_t cores_count = 1;
+        if (IsVendorAmd()) {
+            // Leaf 4 is Intel-only, AMD reports core count
+            // in extended leaf
+            CpuPlatform::Cpuid(kCpuidExtendedBase, 0, &eax, &ebx, &ecx, &edx);
+            if (eax >= kCpuidAmdSize) {
+                CpuPlatform::Cpuid(kCpuidAmdSize, 0, &eax, &ebx, &ecx, &edx);
+                cores_count = (ecx & 0xff) + 1;
+            }
+        } else if (max_leaf >= 4) {
+            CpuPlatform::Cpuid(4, 0, &eax, &ebx, &ecx, &edx);
+            cores_count = ((eax >> 26) & 0x3f) + 1;
+        }
+
+        uint32_t core_bits = CountBits(cores_count);
+        smt_shift_ = package_shift_ > core_bits ? package_shift_ - core_bits : 0;
+    }
+};
+
+} // namespace rt
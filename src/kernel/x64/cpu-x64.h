@@ -37,6 +37,47 @@ public:
         asm volatile("wrmsr" : : "a"(value.lo), "d"(value.hi), "c"(msr));
     }
 
+    static void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* eax,
+                      uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+        asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(subleaf));
+    }
+
+    /**
+     * Check if OS enabled XSAVE extended state management
+     * for current CPU (CR4.OSXSAVE)
+     */
+    static bool IsXSaveEnabled() {
+        uint64_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        return 0 != (cr4 & (1UL << 18));
+    }
+
+    /**
+     * Check if AVX registers can be used, CPU should support
+     * AVX and its state should be enabled in XCR0
+     */
+    static bool IsAVXEnabled() {
+        uint32_t eax, ebx, ecx, edx;
+        Cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+        if (0 == (ecx & (1 << 28)) || !IsXSaveEnabled()) {
+            return false;
+        }
+
+        uint32_t xcr0_lo, xcr0_hi;
+        asm volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        return 0x06 == (xcr0_lo & 0x06); // SSE and AVX state
+    }
+
+    /**
+     * Read time stamp counter
+     */
+    static uint64_t ReadTSC() {
+        uint32_t lo, hi;
+        asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+
     /**
      * Pause operation for busy-wait loops
      */
@@ -44,6 +85,15 @@ public:
         asm volatile("rep;nop" : : : "memory");
     }
 
+    /**
+     * Halt until next interrupt, should be called with interrupts
+     * disabled. STI shadow makes sti;hlt pair atomic so wakeup can't
+     * be lost, interrupts are disabled again on return
+     */
+    static void WaitInterrupt() {
+        asm volatile("sti; hlt; cli" : : : "memory");
+    }
+
     /**
      * Disable interrupts and stop execution
      */
@@ -74,6 +124,15 @@ public:
     inline static void EnableInterrupts() {
         asm volatile("sti");
     }
+
+    /**
+     * Check IF flag of current CPU
+     */
+    inline static bool InterruptsEnabled() {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0" : "=r"(flags));
+        return 0 != (flags & (1 << 9));
+    }
 };
 
 } // namespace rt
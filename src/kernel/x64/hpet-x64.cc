@@ -0,0 +1,148 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hpet-x64.h"
+#include <kernel/kernel.h>
+#include <kernel/cpu.h>
+#include <kernel/mem-manager.h>
+
+namespace rt {
+
+HpetX64::HpetX64(void* address, uint16_t min_tick)
+    :	address_(static_cast<uint8_t*>(address)),
+        min_tick_(min_tick),
+        frequency_(0),
+        timers_count_(0),
+        counter_64bit_(false),
+        oneshot_irq_(-1) {
+    RT_ASSERT(address);
+}
+
+void HpetX64::Init() {
+    GLOBAL_mem_manager()->address_space().MapPage(
+        address_, address_, true, true);
+
+    uint64_t caps = Read(HpetRegister::CAPABILITIES);
+    uint32_t period_fs = static_cast<uint32_t>(caps >> 32);
+    RT_ASSERT(period_fs);
+
+    frequency_ = kFemtosecondsPerSecond / period_fs;
+    timers_count_ = ((caps >> 8) & 0x1f) + 1;
+    counter_64bit_ = 0 != (caps & kCounter64Bit);
+
+    // Disable all comparators, they could be left
+    // enabled by firmware
+    for (uint32_t i = 0; i < timers_count_; ++i) {
+        uint64_t config = Read(HpetRegister::TIMER_CONFIG, i);
+        Write(HpetRegister::TIMER_CONFIG, config & ~kTimerInterruptEnable, i);
+    }
+
+    // Start main counter without legacy replacement routing
+    Write(HpetRegister::CONFIG, kConfigEnable);
+
+    printf("HPET: %d kHz, %d timers, %d bit counter\n",
+           static_cast<uint32_t>(frequency_ / 1000), timers_count_,
+           counter_64bit_ ? 64 : 32);
+}
+
+uint64_t HpetX64::ReadCounter() {
+    if (counter_64bit_) {
+        return Read(HpetRegister::MAIN_COUNTER);
+    }
+
+    // Extend 32 bit counter using last seen value, timer
+    // tick reads it at least once per wrap period
+    for (;;) {
+        uint64_t last = last_counter_.Get();
+        uint32_t low = static_cast<uint32_t>(Read(HpetRegister::MAIN_COUNTER));
+        uint64_t value = (last & ~0xffffffffULL) | low;
+        if (value < last) {
+            value += 0x100000000ULL;
+        }
+
+        if (last_counter_.CompareExchange(last, value)) {
+            return value;
+        }
+    }
+}
+
+uint64_t HpetX64::nanoseconds() {
+    RT_ASSERT(frequency_);
+    uint64_t ticks = ReadCounter();
+    return (ticks / frequency_) * 1000000000ULL
+        + (ticks % frequency_) * 1000000000ULL / frequency_;
+}
+
+void HpetX64::Delay(uint64_t microseconds) {
+    RT_ASSERT(frequency_);
+    uint64_t end = ReadCounter() + frequency_ * microseconds / 1000000;
+    while (ReadCounter() < end) {
+        Cpu::WaitPause();
+    }
+}
+
+int32_t HpetX64::RouteOneShot(uint32_t irq_count) {
+    RT_ASSERT(frequency_);
+    uint64_t config = Read(HpetRegister::TIMER_CONFIG, 0);
+
+    // Pick highest IO APIC input comparator can be routed to,
+    // inputs 0 and 2 are masked for legacy timers
+    uint32_t routes = static_cast<uint32_t>(config >> 32);
+    oneshot_irq_ = -1;
+    for (int32_t irq = 31; irq > 2; --irq) {
+        if (static_cast<uint32_t>(irq) < irq_count
+            && 0 != (routes & (1U << irq))) {
+            oneshot_irq_ = irq;
+            break;
+        }
+    }
+
+    if (oneshot_irq_ < 0) {
+        return -1;
+    }
+
+    // Edge triggered, non-periodic, routed to IO APIC
+    config &= ~(kTimerInterruptEnable | kTimerFsbEnable
+        | (0x1fULL << kTimerRouteShift) | 0xaULL);
+    config |= static_cast<uint64_t>(oneshot_irq_) << kTimerRouteShift;
+    if (!counter_64bit_) {
+        config |= kTimer32Bit;
+    }
+
+    Write(HpetRegister::TIMER_CONFIG, config, 0);
+    return oneshot_irq_;
+}
+
+uint64_t HpetX64::ArmOneShot(uint64_t microseconds) {
+    RT_ASSERT(frequency_);
+    RT_ASSERT(oneshot_irq_ >= 0);
+
+    uint64_t ticks = frequency_ * microseconds / 1000000;
+    if (ticks < min_tick_) {
+        ticks = min_tick_;
+    }
+
+    uint64_t deadline = ReadCounter() + ticks;
+    uint64_t config = Read(HpetRegister::TIMER_CONFIG, 0);
+    Write(HpetRegister::TIMER_COMPARATOR, deadline, 0);
+    Write(HpetRegister::TIMER_CONFIG, config | kTimerInterruptEnable, 0);
+    return deadline;
+}
+
+void HpetX64::CancelOneShot() {
+    uint64_t config = Read(HpetRegister::TIMER_CONFIG, 0);
+    Write(HpetRegister::TIMER_CONFIG, config & ~kTimerInterruptEnable, 0);
+}
+
+} // namespace rt
@@ -0,0 +1,132 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+
+namespace rt {
+
+/**
+ * List of HPET registers, timer registers are relative
+ * to timer block
+ */
+enum class HpetRegister {
+    CAPABILITIES                    = 0x000,  // General Capabilities and ID
+    CONFIG                          = 0x010,  // General Configuration
+    INTERRUPT_STATUS                = 0x020,  // General Interrupt Status
+    MAIN_COUNTER                    = 0x0f0,  // Main Counter Value
+    TIMER_CONFIG                    = 0x100,  // Timer N Configuration and Capability
+    TIMER_COMPARATOR                = 0x108   // Timer N Comparator Value
+};
+
+/**
+ * High Precision Event Timer. Used as monotonic clocksource
+ * and one-shot interrupt source when local apic timer is not
+ * calibrated yet
+ */
+class HpetX64 {
+public:
+    HpetX64(void* address, uint16_t min_tick);
+
+    /**
+     * Map registers and start main counter
+     */
+    void Init();
+
+    /**
+     * Read main counter, 32 bit counters are extended to 64 bit
+     */
+    uint64_t ReadCounter();
+
+    /**
+     * Keep 32 bit counter extension up to date, should be called
+     * more often than counter wraps (~300 s at 14.3 MHz)
+     */
+    void Tick() {
+        if (!counter_64bit_) {
+            ReadCounter();
+        }
+    }
+
+    /**
+     * Monotonic time since counter start
+     */
+    uint64_t nanoseconds();
+
+    /**
+     * Busy-wait using main counter
+     */
+    void Delay(uint64_t microseconds);
+
+    /**
+     * Route first comparator to highest IO APIC input below irq_count
+     * it supports. Returns input number or -1 if there is none, caller
+     * is responsible for programming IO APIC entry
+     */
+    int32_t RouteOneShot(uint32_t irq_count);
+
+    /**
+     * Fire interrupt once after timeout using routed comparator.
+     * Returns main counter value of the deadline
+     */
+    uint64_t ArmOneShot(uint64_t microseconds);
+
+    /**
+     * Disable one-shot comparator
+     */
+    void CancelOneShot();
+
+    /**
+     * IO APIC input of one-shot comparator or -1 if not routed
+     */
+    int32_t oneshot_irq() const { return oneshot_irq_; }
+
+    /**
+     * Counter frequency in Hz
+     */
+    uint64_t frequency() const { return frequency_; }
+
+    uint32_t timers_count() const { return timers_count_; }
+
+private:
+    static const uint64_t kFemtosecondsPerSecond = 1000000000000000ULL;
+    static const uint64_t kConfigEnable = 1 << 0;
+    static const uint64_t kTimerInterruptEnable = 1 << 2;
+    static const uint64_t kTimer32Bit = 1 << 8;
+    static const uint32_t kTimerRouteShift = 9;
+    static const uint64_t kTimerFsbEnable = 1 << 14;
+    static const uint64_t kCounter64Bit = 1 << 13;
+
+    uint8_t* address_;
+    uint16_t min_tick_;
+    uint64_t frequency_;
+    uint32_t timers_count_;
+    bool counter_64bit_;
+    int32_t oneshot_irq_;
+    Atomic<uint64_t> last_counter_;
+
+    inline uint64_t Read(HpetRegister reg, uint32_t timer = 0) const {
+        return *(volatile uint64_t*)(address_ + static_cast<uint32_t>(reg) + timer * 0x20);
+    }
+
+    inline void Write(HpetRegister reg, uint64_t value, uint32_t timer = 0) {
+        *(volatile uint64_t*)(address_ + static_cast<uint32_t>(reg) + timer * 0x20) = value;
+    }
+
+    DELETE_COPY_AND_ASSIGN(HpetX64);
+};
+
+} // namespace rt
@@ -21,6 +21,7 @@ IoApicX64::IoApicX64(uint32_t id, uintptr_t address, uint32_t interrupt_base)
     :	id_(id),
         address_(address),
         interrupt_base_(interrupt_base),
+        irq_count_(0),
         registers_(IoApicRegistersAccessor(address)) {}
 
 void IoApicX64::Init() {
@@ -36,16 +37,14 @@ void IoApicX64::Init() {
     uint32_t max_value = (registers_.Read(IoApicRegister::VER) >> 16) & 0xFF;
     RT_ASSERT(max_value);
 
-    uint32_t max_interrupts = max_value + 1;
+    irq_count_ = max_value + 1;
 
-    const uint32_t kIntMasked = 1 << 16;
     const uint32_t kIntTrigger = 1 << 15;
     const uint32_t kIntActiveLow = 1 << 14;
     const uint32_t kIntDstLogical = 1 << 11;
-    const uint32_t kIRQOffset = 32;
 
     // Enable all interrupts
-    for (uint32_t i = 0; i < max_interrupts; ++i) {
+    for (uint32_t i = 0; i < irq_count_; ++i) {
         // Not sure about IRQ 2, but I get those a lot in QEMU
         if (0 == interrupt_base_ && (0 == i || 2 == i)) {
             // Mask timer and IRQ 2
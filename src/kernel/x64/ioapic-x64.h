@@ -76,10 +76,30 @@ public:
         registers_.SetEntry(irq, first_irq_offset + irq + interrupt_base_);
     }
 
+    /**
+     * Program edge triggered, active high entry of input to
+     * its default vector, overrides mask set by Init
+     */
+    void RouteIrq(uint32_t irq) {
+        RT_ASSERT(irq < irq_count_);
+        EnableIrq(kIRQOffset, irq);
+    }
+
+    uint32_t interrupt_base() const { return interrupt_base_; }
+
+    /**
+     * Number of redirection entries, valid after Init
+     */
+    uint32_t irq_count() const { return irq_count_; }
+
 private:
+    static const uint32_t kIntMasked = 1 << 16;
+    static const uint32_t kIRQOffset = 32;
+
     uint32_t id_;
     uintptr_t address_;
     uint32_t interrupt_base_;
+    uint32_t irq_count_;
     IoApicRegistersAccessor registers_;
     DELETE_COPY_AND_ASSIGN(IoApicX64);
 };
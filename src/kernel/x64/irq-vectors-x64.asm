@@ -45,6 +45,7 @@ public	 _int_gate_exception_other as 'int_gate_exception_other'
 public   _int_gate_irq_timer as 'int_gate_irq_timer'
 public   _int_gate_irq_keyboard as 'int_gate_irq_keyboard'
 public   _int_gate_irq_spurious as 'int_gate_irq_spurious'
+public   _int_gate_irq_cross_call as 'int_gate_irq_cross_call'
 
 public   _switch_to_stack as 'switch_to_stack'
 
@@ -273,6 +274,7 @@ public _irq_gate_fd
 public _irq_gate_fe
 
 
+extrn	 cpu_xsave_enabled
 extrn	 exception_DE_event
 extrn	 exception_DB_event
 extrn	 exception_NMI_event
@@ -296,6 +298,7 @@ extrn	 exception_other_event
 
 extrn    irq_timer_event
 extrn    irq_keyboard_event
+extrn    irq_cross_call_event
 extrn    irq_other_event
 extrn    irq_handler_any
 
@@ -370,85 +373,124 @@ _switch_to_stack:
 ;  ---------------------------------------------------
 ;  begin preempt logic
 
-;  Param: RDI - load thread structure location, 16 bytes aligned
-;               structure size - 1024 bytes
-;                 0 - 512  fx state
-;               512 - 1024 general registers etc
+;  Thread structure layout, 64 bytes aligned, 4096 bytes
+;                 0 - 3584 extended state (XSAVE or FXSAVE area)
+;              3584 - 4096 general registers etc
+
+THREAD_REGS = 3584
+
+;  Check per-CPU XSAVE flag cached by InitCurrentCPU (gs
+;  contains cpu id), clobbers rax
+macro TestXSaveEnabled
+{
+    mov ax, gs
+    movzx eax, ax
+    cmp byte [cpu_xsave_enabled + rax], 0
+}
+
+;  Save extended state into area at base. XSAVE is used when
+;  enabled by OS (CR4.OSXSAVE), clobbers rax and rdx
+macro SaveExtState base
+{
+    local save_fx, save_done
+    TestXSaveEnabled
+    je save_fx
+    mov eax, 0xffffffff
+    mov edx, 0xffffffff
+    xsave [base]
+    jmp save_done
+save_fx:
+    fxsave [base]
+save_done:
+}
+
+;  Restore extended state from area at base, clobbers rax and rdx
+macro RestoreExtState base
+{
+    local restore_fx, restore_done
+    TestXSaveEnabled
+    je restore_fx
+    mov eax, 0xffffffff
+    mov edx, 0xffffffff
+    xrstor [base]
+    jmp restore_done
+restore_fx:
+    fxrstor [base]
+restore_done:
+}
+
+;  Param: RDI - load thread structure location
 
 _enterFirstThread:
 
     xor rax, rax
     push rax                    ; target ss
-    push qword [rdi+560]        ; target rsp
+    push qword [rdi+THREAD_REGS+48] ; target rsp
     pushfq                      ; target flags
     push 0x08                   ; target cs
-    push qword [rdi+568]        ; target rip
-    mov rdi, qword [rdi+576]    ; pass thread pointer as 1st parameter
+    push qword [rdi+THREAD_REGS+56] ; target rip
+    mov rdi, qword [rdi+THREAD_REGS+64] ; pass thread pointer as 1st parameter
     iretq
 
 ;
-;  Param: RDI - save thread structure location, 16 bytes aligned
-;               structure size - 1024 bytes
-;                 0 - 512  fx state
-;               512 - 1024 general registers etc
-;  Param: RSI - load thread structure location, 16 bytes aligned
-;               structure size - 1024 bytes
-;                 0 - 512  fx state
-;               512 - 1024 general registers etc
+;  Param: RDI - save thread structure location
+;  Param: RSI - load thread structure location
 ;
 
 _preemptStart:
     cli
     push rdi
-    fxsave [rdi]
-    mov qword [rdi+512], r15
-    mov qword [rdi+520], r14
-    mov qword [rdi+528], r13
-    mov qword [rdi+536], r12
-    mov qword [rdi+544], rbp
-    mov qword [rdi+552], rbx
-    mov qword [rdi+560], rsp
-    mov qword [rdi+568], _preemptCallback
+    SaveExtState rdi
+    mov qword [rdi+THREAD_REGS+0], r15
+    mov qword [rdi+THREAD_REGS+8], r14
+    mov qword [rdi+THREAD_REGS+16], r13
+    mov qword [rdi+THREAD_REGS+24], r12
+    mov qword [rdi+THREAD_REGS+32], rbp
+    mov qword [rdi+THREAD_REGS+40], rbx
+    mov qword [rdi+THREAD_REGS+48], rsp
+    mov qword [rdi+THREAD_REGS+56], _preemptCallback
 
     xor rax, rax
     push rax                    ; target ss
-    push qword [rsi+560]        ; target rsp
+    push qword [rsi+THREAD_REGS+48] ; target rsp
     pushfq                      ; target flags
     push 0x08                   ; target cs
-    push qword [rsi+568]        ; target rip
-    mov rdi, qword [rsi+576]    ; pass thread pointer as 1st parameter
+    push qword [rsi+THREAD_REGS+56] ; target rip
+    mov rdi, qword [rsi+THREAD_REGS+64] ; pass thread pointer as 1st parameter
     iretq
 
 _preemptCallback:
     pop rdi
-    fxrstor [rdi]
-    mov r15, qword [rdi+512]
-    mov r14, qword [rdi+520]
-    mov r13, qword [rdi+528]
-    mov r12, qword [rdi+536]
-    mov rbp, qword [rdi+544]
-    mov rbx, qword [rdi+552]
-    mov rax, qword [rdi+576]   ; return thread pointer
+    RestoreExtState rdi
+    mov r15, qword [rdi+THREAD_REGS+0]
+    mov r14, qword [rdi+THREAD_REGS+8]
+    mov r13, qword [rdi+THREAD_REGS+16]
+    mov r12, qword [rdi+THREAD_REGS+24]
+    mov rbp, qword [rdi+THREAD_REGS+32]
+    mov rbx, qword [rdi+THREAD_REGS+40]
+    mov rax, qword [rdi+THREAD_REGS+64] ; return thread pointer
     sti
     ret
 
-;  Param: RDI - clean 1024 byte space for thread structure location
+;  Param: RDI - clean 4096 byte space for thread structure location
 ;  Param: RSI - function pointer to thread entry point
 ;  Param: RDX - thread stack location
 ;  Param: RCX - thread object pointer
 
 _threadStructInit:
-    fxsave [rdi]        ; save current state, it could be any valid fxstate
+    push rdx
+    SaveExtState rdi    ; save current state, it could be any valid state
+    pop rdx
     xor rax, rax
-    mov qword [rdi+512], rax
-    mov qword [rdi+520], rax
-    mov qword [rdi+528], rax
-    mov qword [rdi+536], rax
-    mov qword [rdi+544], rax
-    mov qword [rdi+552], rax
-    mov qword [rdi+560], rdx
-    mov qword [rdi+568], rsi
-    mov qword [rdi+576], rcx
+    mov qword [rdi+THREAD_REGS+0], rax
+    mov qword [rdi+THREAD_REGS+8], rax
+    mov qword [rdi+THREAD_REGS+16], rax
+    mov qword [rdi+THREAD_REGS+24], rax
+    mov qword [rdi+THREAD_REGS+32], rax
+    mov qword [rdi+THREAD_REGS+40], rax
+    mov qword [rdi+THREAD_REGS+48], rdx
+    mov qword [rdi+THREAD_REGS+56], rsi
+    mov qword [rdi+THREAD_REGS+64], rcx
     ret
 
 ;  end preempt logic
@@ -634,6 +676,14 @@ _int_gate_irq_keyboard:
     RestoreState
     iretq
 
+align 16
+_int_gate_irq_cross_call:
+
+    SaveState
+    call    irq_cross_call_event
+    RestoreState
+    iretq
+
 align 16
 _irq_gate_20: IrqHandler 0x0
 _irq_gate_21: IrqHandler 0x1
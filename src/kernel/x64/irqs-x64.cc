@@ -16,6 +16,7 @@
 #include <kernel/irqs.h>
 #include <kernel/x64/io-x64.h>
 #include <kernel/x64/irqs-x64.h>
+#include <kernel/cpu.h>
 
 extern "C" {
 #define GATE(NAME) uint64_t NAME()
@@ -43,6 +44,7 @@ extern "C" {
     GATE(int_gate_irq_keyboard);
     GATE(int_gate_irq_other);
     GATE(int_gate_irq_spurious);
+    GATE(int_gate_irq_cross_call);
     GATE(gate_context_switch);
     GATE(_irq_gate_20);
     GATE(_irq_gate_21);
@@ -280,7 +282,7 @@ void IrqsArch::EnableNMI() {
     IoPortsX64::OutB(0x70, IoPortsX64::InB(0x70) & 0x7F);
 }
 
-void IrqsArch::InstallGate(uint8_t vector, uint64_t (*func)(), uint8_t type) {
+void IrqsArch::InstallGate(uint8_t vector, uint64_t (*func)(), uint8_t type, uint8_t ist) {
     uint8_t* idt_table = (uint8_t*)kIDTTableBase;
     uint8_t b[16];
 
@@ -288,7 +290,7 @@ void IrqsArch::InstallGate(uint8_t vector, uint64_t (*func)(), uint8_t type) {
     b[1] = ((uint64_t)func & 0x000000000000FF00) >> 8;
     b[2] = kCodeSelector;
     b[3] = 0;
-    b[4] = 0;
+    b[4] = ist & 0x7;
     b[5] = type;
     b[6] = ((uint64_t)func & 0x0000000000FF0000) >> 16;
     b[7] = ((uint64_t)func & 0x00000000FF000000) >> 24;
@@ -307,6 +309,87 @@ void IrqsArch::InstallGate(uint8_t vector, uint64_t (*func)(), uint8_t type) {
     }
 }
 
+void IrqsArch::AllocCpuTables(uint32_t cpu) {
+    RT_ASSERT(cpu < kMaxCpus);
+    if (nullptr != cpu_tables_[cpu]) {
+        return;
+    }
+
+    // Everything is written here, so all pages are mapped
+    // before CPU loads the tables
+    CpuTablesX64* tables = new CpuTablesX64();
+    memset(tables, 0, sizeof(CpuTablesX64));
+
+    // Boot GDT is shared, copy it and append 16 byte TSS descriptor
+    memcpy(tables->gdt, reinterpret_cast<void*>(kBootGDTBase),
+           kBootGDTEntries * sizeof(uint64_t));
+    tables->tss.iomap_base = sizeof(TssX64);
+
+    uint8_t ists[] = { kIstPageFault, kIstDoubleFault };
+    for (uint8_t ist : ists) {
+        uint8_t* stack = new uint8_t[kExceptionStackSize];
+        memset(stack, 0, kExceptionStackSize);
+        tables->tss.ist[ist - 1] = reinterpret_cast<uint64_t>(
+            stack + kExceptionStackSize) & ~0xfULL;
+    }
+
+    uint64_t base = reinterpret_cast<uint64_t>(&tables->tss);
+    uint64_t limit = sizeof(TssX64) - 1;
+    tables->gdt[kBootGDTEntries] = (limit & 0xffff)
+        | ((base & 0xffffff) << 16)
+        | (0x89ULL << 40)                   // Present, available 64 bit TSS
+        | (((limit >> 16) & 0xf) << 48)
+        | (((base >> 24) & 0xff) << 56);
+    tables->gdt[kBootGDTEntries + 1] = base >> 32;
+
+    cpu_tables_[cpu] = tables;
+}
+
+void IrqsArch::PrepareCpus(uint32_t cpu_count) {
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < kMaxCpus; ++cpu) {
+        AllocCpuTables(cpu);
+    }
+}
+
+void IrqsArch::InitCurrentCPU() {
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < kMaxCpus);
+
+    // Exception stacks are not enabled before BSP loads its TSS,
+    // so BSP can take page faults here. APs can't, their tables
+    // are allocated by BSP in PrepareCpus
+    if (0 == cpu) {
+        AllocCpuTables(cpu);
+    }
+
+    CpuTablesX64* tables = cpu_tables_[cpu];
+    RT_ASSERT(tables);
+
+    struct {
+        uint16_t limit;
+        uint64_t base;
+    } __attribute__((packed)) gdtr = {
+        static_cast<uint16_t>(sizeof(tables->gdt) - 1),
+        reinterpret_cast<uint64_t>(tables->gdt)
+    };
+
+    // Code and data selectors are the same, segment
+    // registers don't need to be reloaded
+    asm volatile("lgdt %0" :: "m"(gdtr));
+    asm volatile("ltr %0" :: "r"(kTssSelector));
+
+    if (0 != cpu) {
+        return;
+    }
+
+    // IDT is shared, exception stacks are enabled once BSP TSS
+    // is loaded. Page fault handler should not fault itself,
+    // nested fault would reuse the same stack
+    uint8_t type = 0x8e;
+    InstallGate(0x08, &int_gate_exception_DF, type, kIstDoubleFault);
+    InstallGate(0x0E, &int_gate_exception_PF, type, kIstPageFault);
+}
+
 void IrqsArch::SetUp() {
     DisableNMI();
 
@@ -589,7 +672,9 @@ void IrqsArch::SetUp() {
     InstallGate(0xfb, &_irq_gate_fb, type);
     InstallGate(0xfc, &_irq_gate_fc, type);
     InstallGate(0xfd, &_irq_gate_fd, type);
-    InstallGate(0xfe, &_irq_gate_fe, type);
+
+    // Cross calls
+    InstallGate(kCrossCallVector, &int_gate_irq_cross_call, type);
 
     // Spurious
     InstallGate(0xff, &int_gate_irq_spurious, type);
@@ -18,17 +18,68 @@
 
 namespace rt {
 
+/**
+ * 64 bit task state segment, only used to provide interrupt
+ * stack table for exception handlers
+ */
+struct TssX64 {
+    uint32_t reserved1;
+    uint64_t rsp[3];
+    uint64_t reserved2;
+    uint64_t ist[7];
+    uint64_t reserved3;
+    uint16_t reserved4;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+/**
+ * Per-CPU GDT copy with TSS descriptor and the TSS itself
+ */
+struct CpuTablesX64 {
+    uint64_t gdt[5];    // Boot GDT entries and 16 byte TSS descriptor
+    TssX64 tss;
+};
+
 class IrqsArch {
 public:
-    IrqsArch() {}
+    IrqsArch() {
+        memset(cpu_tables_, 0, sizeof(cpu_tables_));
+    }
+
     void SetUp();
+
+    /**
+     * Load GDT and TSS with exception stacks for current CPU. Page
+     * faults are handled on separate stack, this way thread stacks
+     * can grow on demand. Requires malloc on BSP, APs use tables
+     * made by PrepareCpus and don't touch unmapped memory
+     */
+    void InitCurrentCPU();
+
+    /**
+     * Allocate and map tables of all CPUs, called on BSP
+     * before APs are started
+     */
+    void PrepareCpus(uint32_t cpu_count);
+
+    static const uint8_t kCrossCallVector = 0xfe;
 private:
     void DisableNMI();
     void EnableNMI();
-    void InstallGate(uint8_t vector, uint64_t (*func)(), uint8_t type);
+    void InstallGate(uint8_t vector, uint64_t (*func)(), uint8_t type, uint8_t ist = 0);
+    void AllocCpuTables(uint32_t cpu);
 
     static const uint64_t kIDTTableBase = 0;
+    static const uint64_t kBootGDTBase = 0x1000;
     static const uint8_t kCodeSelector = 0x8;
+    static const uint16_t kTssSelector = 0x18;
+    static const uint32_t kBootGDTEntries = 3;
+    static const uint8_t kIstPageFault = 1;
+    static const uint8_t kIstDoubleFault = 2;
+    static const size_t kExceptionStackSize = 64 * 1024;
+    static const uint32_t kMaxCpus = 256;
+
+    CpuTablesX64* cpu_tables_[kMaxCpus];
     DELETE_COPY_AND_ASSIGN(IrqsArch);
 };
 
@@ -18,21 +18,33 @@
 #include <kernel/mem-manager.h>
 #include <kernel/system-context.h>
 #include <kernel/x64/io-x64.h>
+#include <kernel/x64/hpet-x64.h>
 
 namespace rt {
 
 LocalApicX64::LocalApicX64(void* local_apic_address)
     :	local_apic_address_(local_apic_address),
-        registers_(local_apic_address),
-        bus_freq_(0) {
+        registers_(local_apic_address, IsX2ApicSupported()),
+        bus_freq_(0),
+        tsc_freq_(0) {
     RT_ASSERT(local_apic_address);
 }
 
-void LocalApicX64::InitCpu() {
+void LocalApicX64::InitCpu(HpetX64* hpet) {
     GLOBAL_mem_manager()->address_space().MapPage(
         local_apic_address_,
         local_apic_address_, true, true);
 
+    // Switch to x2APIC mode, this is per-cpu setting and
+    // should be done before any register access
+    if (registers_.is_x2apic()) {
+        CpuMSRValue base = CpuPlatform::GetMSR(kApicBaseMSR);
+        base.lo |= kApicBaseGlobalEnable;
+        CpuPlatform::SetMSR(kApicBaseMSR, base);
+        base.lo |= kApicBaseX2ApicEnable;
+        CpuPlatform::SetMSR(kApicBaseMSR, base);
+    }
+
     // Clear task priority to enable all interrupts
     registers_.Write(LocalApicRegister::TASK_PRIORITY, 0);
 
@@ -44,11 +56,15 @@ void LocalApicX64::InitCpu() {
     // Perf
     registers_.Write(LocalApicRegister::PERF, 4 << 8);
 
-    // Flat mode
-    registers_.Write(LocalApicRegister::DESTINATION_FORMAT, 0xF0000000);
+    // x2APIC has no destination format register and logical
+    // destination is read-only (derived from x2APIC ID)
+    if (!registers_.is_x2apic()) {
+        // Flat mode
+        registers_.Write(LocalApicRegister::DESTINATION_FORMAT, 0xF0000000);
 
-    // Logical Destination Mode, all cpus use logical id 1
-    registers_.Write(LocalApicRegister::LOGICAL_DESTINATION, 1);
+        // Logical Destination Mode, all cpus use logical id 1
+        registers_.Write(LocalApicRegister::LOGICAL_DESTINATION, 1);
+    }
 
     // Configure Spurious Interrupt Vector Register
     registers_.Write(LocalApicRegister::SPURIOUS_INTERRUPT_VECTOR, 0x100 | 0xff);
@@ -57,37 +73,23 @@ void LocalApicX64::InitCpu() {
         // Ensure we do this once on CPU 0
         RT_ASSERT(0 == Cpu::id());
 
-        // Calibrate times
-        registers_.Write(LocalApicRegister::TIMER, 32);
-        registers_.Write(LocalApicRegister::TIMER_DIVIDE_CONFIG, 0x03);
-
-        // Initialize PIT channel 2 in one-shot mode to wait 1/100 sec
-        IoPortsX64::OutB(0x61, (IoPortsX64::InB(0x61) & 0xFD) | 1);
-        IoPortsX64::OutB(0x43, 0xB2);
-
-        // 1193180/100 Hz = 11931 = 2e9bh
-        IoPortsX64::OutB(0x42, 0x9B);					// LSB
-        IoPortsX64::InB(0x60);							// Short delay
-        IoPortsX64::OutB(0x42, 0x2E);					// MSB
-
-        // Reset PIT one-shot counter (start counting)
-        uint32_t tmp = (uint8_t)(IoPortsX64::InB(0x61) & 0xFE);
-        IoPortsX64::OutB(0x61, (uint8_t)tmp);           //gate low
-        IoPortsX64::OutB(0x61, (uint8_t)tmp | 1);		//gate high
-
-        // Reset APIC timer (set counter to -1)
-        registers_.Write(LocalApicRegister::TIMER_INITIAL_COUNT, 0xFFFFFFFF);
+        const char* source = "cpuid";
+        if (!CalibrateFromCpuid()) {
+            if (0 != tsc_freq_) {
+                source = "tsc";
+                CalibrateWithTsc();
+            } else if (nullptr != hpet) {
+                source = "hpet";
+                CalibrateWithHpet(hpet);
+            } else {
+                source = "pit";
+                CalibrateWithPit();
+            }
+        }
 
-        // Wait until PIT counter reaches zero
-        while(!(IoPortsX64::InB(0x61) & 0x20));
-
-        // Stop Apic timer
-        registers_.Write(LocalApicRegister::TIMER, 1 << 16);
-
-        // Calculate bus frequency
-        uint32_t curr_count = registers_.Read(LocalApicRegister::TIMER_CURRENT_COUNT);
-        uint32_t cpubusfreq = ((0xFFFFFFFF - curr_count) + 1) * 16 * 100;
-        bus_freq_ = cpubusfreq;
+        printf("Local APIC timer: %d kHz (%s), TSC: %d kHz\n",
+               static_cast<uint32_t>(bus_freq_ / 1000), source,
+               static_cast<uint32_t>(tsc_freq_ / 1000));
     }
 
     RT_ASSERT(bus_freq_);
@@ -106,4 +108,158 @@ void LocalApicX64::InitCpu() {
     registers_.Write(LocalApicRegister::TIMER_DIVIDE_CONFIG, 0x03);
 }
 
+bool LocalApicX64::CalibrateFromCpuid() {
+    uint32_t eax, ebx, ecx, edx;
+
+    // Hypervisor timing leaf reports both frequencies in kHz,
+    // it's only defined by KVM and VMware
+    CpuPlatform::Cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (0 != (ecx & (1U << 31))) {
+        CpuPlatform::Cpuid(kCpuidHypervisorBase, 0, &eax, &ebx, &ecx, &edx);
+        bool is_kvm = 0x4b4d564b == ebx && 0x564b4d56 == ecx
+            && 0x0000004d == edx;       // "KVMKVMKVM\0\0\0"
+        bool is_vmware = 0x61774d56 == ebx && 0x4d566572 == ecx
+            && 0x65726177 == edx;       // "VMwareVMware"
+        if ((is_kvm || is_vmware) && eax >= kCpuidHypervisorTiming) {
+            CpuPlatform::Cpuid(kCpuidHypervisorTiming, 0, &eax, &ebx, &ecx, &edx);
+            if (0 != eax) {
+                tsc_freq_ = static_cast<uint64_t>(eax) * 1000;
+            }
+            if (0 != ebx) {
+                bus_freq_ = ebx * 1000;
+                return 0 != tsc_freq_;
+            }
+        }
+    }
+
+    CpuPlatform::Cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+    if (max_leaf < kCpuidTscLeaf) {
+        return false;
+    }
+
+    // TSC / crystal clock ratio and crystal clock frequency
+    CpuPlatform::Cpuid(kCpuidTscLeaf, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t denominator = eax;
+    uint32_t numerator = ebx;
+    uint64_t crystal_hz = ecx;
+    if (0 == denominator || 0 == numerator) {
+        return false;
+    }
+
+    // Crystal frequency is not enumerated, derive it from
+    // processor base frequency in MHz
+    if (0 == crystal_hz && max_leaf >= kCpuidFrequencyLeaf) {
+        CpuPlatform::Cpuid(kCpuidFrequencyLeaf, 0, &eax, &ebx, &ecx, &edx);
+        crystal_hz = static_cast<uint64_t>(eax & 0xffff) * 1000000
+            * denominator / numerator;
+    }
+
+    if (0 == crystal_hz) {
+        return false;
+    }
+
+    // Local APIC timer runs at core crystal clock frequency
+    tsc_freq_ = crystal_hz * numerator / denominator;
+    bus_freq_ = crystal_hz;
+    return true;
+}
+
+void LocalApicX64::CalibrateWithTsc() {
+    RT_ASSERT(tsc_freq_);
+    uint64_t wait_ticks = tsc_freq_ / 1000000 * kTscCalibrationMicroseconds;
+
+    registers_.Write(LocalApicRegister::TIMER, 32 | (1 << 16));
+    registers_.Write(LocalApicRegister::TIMER_DIVIDE_CONFIG, 0x03);
+    registers_.Write(LocalApicRegister::TIMER_INITIAL_COUNT, 0xFFFFFFFF);
+
+    uint64_t tsc_start = CpuPlatform::ReadTSC();
+    uint64_t tsc_now = tsc_start;
+    while (tsc_now - tsc_start < wait_ticks) {
+        tsc_now = CpuPlatform::ReadTSC();
+    }
+    uint32_t curr_count = registers_.Read(LocalApicRegister::TIMER_CURRENT_COUNT);
+    registers_.Write(LocalApicRegister::TIMER_INITIAL_COUNT, 0);
+
+    // Scale by measured TSC interval which can be slightly
+    // longer than requested
+    uint64_t apic_ticks = static_cast<uint64_t>(0xFFFFFFFF - curr_count) * 16;
+    bus_freq_ = apic_ticks * tsc_freq_ / (tsc_now - tsc_start);
+}
+
+void LocalApicX64::CalibrateWithHpet(HpetX64* hpet) {
+    RT_ASSERT(hpet);
+    RT_ASSERT(hpet->frequency());
+    uint64_t wait_ticks = hpet->frequency() / 1000000 * kTscCalibrationMicroseconds;
+
+    registers_.Write(LocalApicRegister::TIMER, 32 | (1 << 16));
+    registers_.Write(LocalApicRegister::TIMER_DIVIDE_CONFIG, 0x03);
+
+    uint64_t hpet_start = hpet->ReadCounter();
+    registers_.Write(LocalApicRegister::TIMER_INITIAL_COUNT, 0xFFFFFFFF);
+    uint64_t tsc_start = CpuPlatform::ReadTSC();
+
+    uint64_t hpet_now = hpet_start;
+    if (hpet->oneshot_irq() >= 0 && !Cpu::InterruptsEnabled()) {
+        // Sleep until comparator interrupt instead of polling,
+        // other interrupts only wake CPU early
+        uint64_t deadline = hpet->ArmOneShot(kTscCalibrationMicroseconds);
+        while (hpet_now < deadline) {
+            CpuPlatform::WaitInterrupt();
+            hpet_now = hpet->ReadCounter();
+        }
+        hpet->CancelOneShot();
+    } else {
+        while (hpet_now - hpet_start < wait_ticks) {
+            hpet_now = hpet->ReadCounter();
+        }
+    }
+
+    uint32_t curr_count = registers_.Read(LocalApicRegister::TIMER_CURRENT_COUNT);
+    uint64_t tsc_end = CpuPlatform::ReadTSC();
+    registers_.Write(LocalApicRegister::TIMER_INITIAL_COUNT, 0);
+
+    uint64_t elapsed = hpet_now - hpet_start;
+    uint64_t apic_ticks = static_cast<uint64_t>(0xFFFFFFFF - curr_count) * 16;
+    bus_freq_ = apic_ticks * hpet->frequency() / elapsed;
+    tsc_freq_ = (tsc_end - tsc_start) * hpet->frequency() / elapsed;
+}
+
+void LocalApicX64::CalibrateWithPit() {
+    // Calibrate times
+    registers_.Write(LocalApicRegister::TIMER, 32);
+    registers_.Write(LocalApicRegister::TIMER_DIVIDE_CONFIG, 0x03);
+
+    // Initialize PIT channel 2 in one-shot mode to wait 1/100 sec
+    IoPortsX64::OutB(0x61, (IoPortsX64::InB(0x61) & 0xFD) | 1);
+    IoPortsX64::OutB(0x43, 0xB2);
+
+    // 1193180/100 Hz = 11931 = 2e9bh
+    IoPortsX64::OutB(0x42, 0x9B);					// LSB
+    IoPortsX64::InB(0x60);							// Short delay
+    IoPortsX64::OutB(0x42, 0x2E);					// MSB
+
+    // Reset PIT one-shot counter (start counting)
+    uint32_t tmp = (uint8_t)(IoPortsX64::InB(0x61) & 0xFE);
+    IoPortsX64::OutB(0x61, (uint8_t)tmp);           //gate low
+    IoPortsX64::OutB(0x61, (uint8_t)tmp | 1);		//gate high
+
+    // Reset APIC timer (set counter to -1)
+    registers_.Write(LocalApicRegister::TIMER_INITIAL_COUNT, 0xFFFFFFFF);
+    uint64_t tsc_start = CpuPlatform::ReadTSC();
+
+    // Wait until PIT counter reaches zero
+    while(!(IoPortsX64::InB(0x61) & 0x20));
+    uint64_t tsc_end = CpuPlatform::ReadTSC();
+
+    // Stop Apic timer
+    registers_.Write(LocalApicRegister::TIMER, 1 << 16);
+
+    // Calculate bus frequency
+    uint32_t curr_count = registers_.Read(LocalApicRegister::TIMER_CURRENT_COUNT);
+    uint32_t cpubusfreq = ((0xFFFFFFFF - curr_count) + 1) * 16 * 100;
+    bus_freq_ = cpubusfreq;
+    tsc_freq_ = (tsc_end - tsc_start) * 100;
+}
+
 } // namespace rt
@@ -20,9 +20,12 @@
 #include <stdlib.h>
 #include <kernel/kernel.h>
 #include <kernel/spinlock.h>
+#include <kernel/x64/cpu-x64.h>
 
 namespace rt {
 
+class HpetX64;
+
 /**
  * List of available local apic registers
  */
@@ -92,8 +95,8 @@ public:
                               bool is_no_deassert,
                               bool trigger_mode,
                               DestinationShorthand dshort,
-                              uint8_t dest) :
-        hi_(dest << 24),
+                              uint32_t dest) :
+        dest_(dest),
         lo_(vector_num |
             (static_cast<uint32_t>(dmode) << 8) |
             (static_cast<uint32_t>(destmode) << 11) |
@@ -101,35 +104,65 @@ public:
             (static_cast<uint32_t>(trigger_mode) << 15) |
             (static_cast<uint32_t>(dshort) << 18)) {}
 private:
-    uint32_t hi_;
+    uint32_t dest_;
     uint32_t lo_;
 };
 
 /**
- * Provides access to local apic registers
+ * Provides access to local apic registers, either through
+ * MMIO window (xAPIC) or MSRs (x2APIC)
  */
 class LocalApicRegisterAccessor {
 public:
-    LocalApicRegisterAccessor(void* local_apic_base) :
-        local_apic_base_(static_cast<uint8_t*>(local_apic_base)) {
-        RT_ASSERT(local_apic_base);
+    LocalApicRegisterAccessor(void* local_apic_base, bool x2apic) :
+        local_apic_base_(static_cast<uint8_t*>(local_apic_base)),
+        x2apic_(x2apic) {
+        RT_ASSERT(local_apic_base || x2apic);
     }
 
+    static const uint32_t kX2ApicMsrBase = 0x800;
+
     inline uint32_t Read(LocalApicRegister reg) {
+        if (x2apic_) {
+            return CpuPlatform::GetMSR(RegisterMSR(reg)).lo;
+        }
+
         return *(volatile uint32_t*)(local_apic_base_ + static_cast<uint32_t>(reg));
     }
 
     inline void Write(LocalApicRegister reg, uint32_t value) {
+        if (x2apic_) {
+            CpuPlatform::SetMSR(RegisterMSR(reg), CpuMSRValue(value, 0));
+            return;
+        }
+
         *(volatile uint32_t*)(local_apic_base_ + static_cast<uint32_t>(reg)) = value;
     }
 
+    /**
+     * Send IPI. In x2APIC mode command register is 64 bit wide
+     * and written with single WRMSR
+     */
     inline void InterruptCommand(LocalApicInterruptCommand command) {
-        Write(LocalApicRegister::INTERRUPT_COMMAND_HI, command.hi_);
+        if (x2apic_) {
+            CpuPlatform::SetMSR(RegisterMSR(LocalApicRegister::INTERRUPT_COMMAND_LO),
+                                CpuMSRValue(command.lo_, command.dest_));
+            return;
+        }
+
+        Write(LocalApicRegister::INTERRUPT_COMMAND_HI, command.dest_ << 24);
         Write(LocalApicRegister::INTERRUPT_COMMAND_LO, command.lo_);
     }
 
+    bool is_x2apic() const { return x2apic_; }
+
 private:
     uint8_t* local_apic_base_;
+    bool x2apic_;
+
+    static uint32_t RegisterMSR(LocalApicRegister reg) {
+        return kX2ApicMsrBase + (static_cast<uint32_t>(reg) >> 4);
+    }
 };
 
 class LocalApicX64 {
@@ -139,7 +172,7 @@ public:
     /**
      * Send INIT command
      */
-    void SendApicInit(uint8_t apicid) {
+    void SendApicInit(uint32_t apicid) {
         registers_.InterruptCommand(LocalApicInterruptCommand(
             0,
             LocalApicInterruptCommand::DeliveryMode::INIT,
@@ -154,7 +187,7 @@ public:
     /**
      * Send STARTUP command
      */
-    void SendApicStartup(uint8_t apicid, uint8_t vector_num) {
+    void SendApicStartup(uint32_t apicid, uint8_t vector_num) {
         registers_.InterruptCommand(LocalApicInterruptCommand(
             vector_num,
             LocalApicInterruptCommand::DeliveryMode::STARTUP,
@@ -166,6 +199,51 @@ public:
         ));
     }
 
+    /**
+     * Send INIT command to all CPUs except current one
+     */
+    void SendApicInitAll() {
+        registers_.InterruptCommand(LocalApicInterruptCommand(
+            0,
+            LocalApicInterruptCommand::DeliveryMode::INIT,
+            LocalApicInterruptCommand::DestinationMode::PHYSICAL,
+            true,
+            false,
+            LocalApicInterruptCommand::DestinationShorthand::ALL_EXCEPT_SELF,
+            0
+        ));
+    }
+
+    /**
+     * Send STARTUP command to all CPUs except current one
+     */
+    void SendApicStartupAll(uint8_t vector_num) {
+        registers_.InterruptCommand(LocalApicInterruptCommand(
+            vector_num,
+            LocalApicInterruptCommand::DeliveryMode::STARTUP,
+            LocalApicInterruptCommand::DestinationMode::PHYSICAL,
+            true,
+            false,
+            LocalApicInterruptCommand::DestinationShorthand::ALL_EXCEPT_SELF,
+            0
+        ));
+    }
+
+    /**
+     * Send fixed interrupt to single CPU
+     */
+    void SendIPI(uint32_t apicid, uint8_t vector_num) {
+        registers_.InterruptCommand(LocalApicInterruptCommand(
+            vector_num,
+            LocalApicInterruptCommand::DeliveryMode::FIXED,
+            LocalApicInterruptCommand::DestinationMode::PHYSICAL,
+            true,
+            false,
+            LocalApicInterruptCommand::DestinationShorthand::NONE,
+            apicid
+        ));
+    }
+
     /**
      * Set EOI (End Of Interrupt) flag. Interrupt handler must
      * do it before IRETQ
@@ -175,20 +253,78 @@ public:
     }
 
     /**
-     * Read Local Apic ID
+     * Read Local Apic ID. x2APIC ID is full 32 bit register,
+     * xAPIC ID is stored in bits 24-31
      */
     uint32_t Id() {
-        return registers_.Read(LocalApicRegister::ID);
+        uint32_t id = registers_.Read(LocalApicRegister::ID);
+        return registers_.is_x2apic() ? id : id >> 24;
     }
 
     uint32_t bus_frequency() const { return bus_freq_; }
 
-    void InitCpu();
+    /**
+     * Returns TSC frequency in Hz, calibrated together
+     * with bus frequency
+     */
+    uint64_t tsc_frequency() const { return tsc_freq_; }
+
+    /**
+     * Returns true if local apics are accessed using MSRs
+     */
+    bool is_x2apic() const { return registers_.is_x2apic(); }
+
+    /**
+     * Check if CPU supports x2APIC mode (CPUID.01H:ECX[21])
+     */
+    static bool IsX2ApicSupported() {
+        uint32_t eax, ebx, ecx, edx;
+        CpuPlatform::Cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+        return 0 != (ecx & (1 << 21));
+    }
+
+    /**
+     * Initialize local apic of current CPU, HPET is used for
+     * timer calibration if available
+     */
+    void InitCpu(HpetX64* hpet);
 
 private:
+    static const uint32_t kApicBaseMSR = 0x1b;
+    static const uint32_t kApicBaseGlobalEnable = 1 << 11;
+    static const uint32_t kApicBaseX2ApicEnable = 1 << 10;
+    static const uint32_t kCpuidTscLeaf = 0x15;
+    static const uint32_t kCpuidFrequencyLeaf = 0x16;
+    static const uint32_t kCpuidHypervisorBase = 0x40000000;
+    static const uint32_t kCpuidHypervisorTiming = 0x40000010;
+    static const uint64_t kTscCalibrationMicroseconds = 1000;
+
+    /**
+     * Get timer and TSC frequencies from CPUID leaves 0x15/0x16
+     * or hypervisor timing leaf, no waiting required
+     */
+    bool CalibrateFromCpuid();
+
+    /**
+     * Measure timer against known TSC frequency
+     */
+    void CalibrateWithTsc();
+
+    /**
+     * Measure timer and TSC against HPET main counter, halts
+     * on HPET one-shot interrupt if comparator is routed
+     */
+    void CalibrateWithHpet(HpetX64* hpet);
+
+    /**
+     * Measure timer and TSC using 10ms PIT one-shot
+     */
+    void CalibrateWithPit();
+
     void* local_apic_address_;
     LocalApicRegisterAccessor registers_;
     uint32_t bus_freq_;
+    uint64_t tsc_freq_;
     ~LocalApicX64() = delete;
     DELETE_COPY_AND_ASSIGN(LocalApicX64);
 };
@@ -15,20 +15,41 @@
 #include <kernel/platform.h>
 #include <kernel/kernel.h>
 #include <kernel/cpu.h>
+#include <kernel/irqs.h>
+#include <kernel/x64/irqs-x64.h>
+#include <kernel/x64/hpet-x64.h>
+
+/**
+ * CR4.OSXSAVE state of each CPU, thread switch code reads it
+ * instead of CR4
+ */
+extern "C" uint8_t cpu_xsave_enabled[rt::PlatformArch::kMaxCpus];
+uint8_t cpu_xsave_enabled[rt::PlatformArch::kMaxCpus];
 
 namespace rt {
 
 void PlatformArch::StartCPUs() {
+    // APs load their exception stacks before they
+    // can handle page faults
+    GLOBAL_irqs()->PrepareCpus(acpi_.cpus_count());
     acpi_.StartCPUs();
 }
 
 void PlatformArch::InitCurrentCPU() {
+    uint32_t cpu = Cpu::id();
+    RT_ASSERT(cpu < kMaxCpus);
+    cpu_xsave_enabled[cpu] = CpuPlatform::IsXSaveEnabled() ? 1 : 0;
+
     if (0 == Cpu::id()) {
         acpi_.InitIoApics();
+        printf("CPU extended state: xsave %d, avx %d\n",
+               CpuPlatform::IsXSaveEnabled(), CpuPlatform::IsAVXEnabled());
+        printf("Local APIC mode: x2apic %d\n", acpi_.local_apic()->is_x2apic());
     }
 
     RT_ASSERT(acpi_.local_apic());
-    acpi_.local_apic()->InitCpu();
+    acpi_.local_apic()->InitCpu(acpi_.hpet());
+    acpi_.RegisterCurrentCPU();
 }
 
 void PlatformArch::AckIRQ() {
@@ -36,5 +57,26 @@ void PlatformArch::AckIRQ() {
     acpi_.local_apic()->EOI();
 }
 
+uint64_t PlatformArch::ClockNanoseconds() {
+    if (nullptr != acpi_.hpet()) {
+        return acpi_.hpet()->nanoseconds();
+    }
+
+    // TSC is used if HPET is not available, it might be not
+    // synchronized across CPUs or not invariant
+    RT_ASSERT(acpi_.local_apic());
+    uint64_t tsc_freq = acpi_.local_apic()->tsc_frequency();
+    RT_ASSERT(tsc_freq);
+    uint64_t tsc = CpuPlatform::ReadTSC();
+    return (tsc / tsc_freq) * 1000000000ULL
+        + (tsc % tsc_freq) * 1000000000ULL / tsc_freq;
+}
+
+void PlatformArch::SendCrossCallIPI(uint32_t cpu) {
+    RT_ASSERT(acpi_.local_apic());
+    acpi_.local_apic()->SendIPI(acpi_.cpu_apic_id(cpu),
+                                IrqsArch::kCrossCallVector);
+}
+
 } // namespace rt
 
@@ -17,6 +17,10 @@
 #include <kernel/platform.h>
 #include <kernel/x64/acpi-x64.h>
 #include <kernel/x64/local-apic-x64.h>
+#include <kernel/x64/hpet-x64.h>
+#include <kernel/x64/io-x64.h>
+#include <kernel/x64/address-space-x64.h>
+#include <kernel/x64/ps2-x64.h>
 
 namespace rt {
 
@@ -25,17 +29,52 @@ public:
     PlatformArch() {
     }
 
+    static const uint32_t kMaxCpus = 256;
+
     void InitCurrentCPU();
     void StartCPUs();
     void AckIRQ();
+    void SendCrossCallIPI(uint32_t cpu);
+    uint64_t ClockNanoseconds();
+
+    void TimerTick() {
+        if (nullptr != acpi_.hpet()) {
+            acpi_.hpet()->Tick();
+        }
+    }
+
+    void InvalidatePage(void* virtaddr) {
+        AddressSpaceX64::InvalidatePage(virtaddr);
+    }
+
+    void InvalidateAll() { AddressSpaceX64::InvalidateAll(); }
+
+    uint8_t PciReadB(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+        return IoPortsX64::PciReadB(bus, slot, func, offset);
+    }
+
+    uint16_t PciReadW(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+        return IoPortsX64::PciReadW(bus, slot, func, offset);
+    }
+
+    IrqDataSource* CreateKeyboardDataSource() {
+        return new Ps2ScancodeRingX64();
+    }
+
+    uint8_t keyboard_irq() const { return kPs2KeyboardIrq; }
 
     uint32_t cpu_count() const { return acpi_.cpus_count(); }
 
+    CpuTopology cpu_topology(uint32_t cpu) const {
+        return acpi_.cpu_topology(cpu);
+    }
+
     uint32_t bus_frequency() const {
         RT_ASSERT(acpi_.local_apic());
         return acpi_.local_apic()->bus_frequency();
     }
 private:
+    static const uint8_t kPs2KeyboardIrq = 1;
     AcpiX64 acpi_;
     DELETE_COPY_AND_ASSIGN(PlatformArch);
 };
@@ -0,0 +1,99 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <kernel/spinlock.h>
+#include <kernel/irq-data-source.h>
+#include <kernel/x64/io-x64.h>
+
+namespace rt {
+
+/**
+ * Ring of bytes drained from PS/2 controller in IRQ context.
+ * Engine thread takes all buffered scancodes with single message
+ */
+class Ps2ScancodeRingX64 : public IrqDataSource {
+public:
+    Ps2ScancodeRingX64()
+        :	head_(0),
+            tail_(0),
+            pending_(false) {}
+
+    static const uint32_t kSize = kMaxBatch;
+
+    bool Drain() override {
+        ScopedLock lock(locker_);
+
+        // Limit reads in case controller keeps status bit set
+        for (uint32_t i = 0; i < kSize; ++i) {
+            uint8_t status = IoPortsX64::InB(kStatusPort);
+            if (0 == (status & kStatusOutputFull)) {
+                break;
+            }
+
+            uint8_t value = IoPortsX64::InB(kDataPort);
+
+            // Byte came from auxiliary (mouse) port
+            if (status & kStatusAuxData) {
+                continue;
+            }
+
+            if (head_ - tail_ < kSize) {
+                data_[head_++ % kSize] = value;
+            }
+        }
+
+        if (pending_ || head_ == tail_) {
+            return false;
+        }
+
+        pending_ = true;
+        return true;
+    }
+
+    void CancelPending() override {
+        ScopedLock lock(locker_);
+        pending_ = false;
+    }
+
+    uint32_t Take(uint8_t* out, uint32_t max) override {
+        NoInterrupsScope no_interrupts;
+        ScopedLock lock(locker_);
+
+        uint32_t count = 0;
+        while (tail_ != head_ && count < max) {
+            out[count++] = data_[tail_++ % kSize];
+        }
+
+        pending_ = false;
+        return count;
+    }
+
+private:
+    static const uint16_t kDataPort = 0x60;
+    static const uint16_t kStatusPort = 0x64;
+    static const uint8_t kStatusOutputFull = 0x01;
+    static const uint8_t kStatusAuxData = 0x20;
+
+    uint8_t data_[kSize];
+    uint32_t head_;
+    uint32_t tail_;
+    bool pending_;
+    Locker locker_;
+    DELETE_COPY_AND_ASSIGN(Ps2ScancodeRingX64);
+};
+
+} // namespace rt
@@ -0,0 +1,110 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cc/test.h>
+#include <kernel/mem-manager.h>
+
+namespace test {
+
+using namespace rt;
+
+TEST(MemManager) {
+
+    describe("PagesZones") {
+        it("should insert disjoint ranges as is", function {
+            PagesZones zones;
+            PagesZone pieces[PagesZones::kMaxZones + 1];
+            assert_eq(zones.Insert(10, 20, pieces), 1);
+            assert_eq(pieces[0].first_page, 10);
+            assert_eq(pieces[0].last_page, 20);
+            assert_eq(zones.Insert(30, 40, pieces), 1);
+            assert_eq(pieces[0].first_page, 30);
+            assert_eq(pieces[0].last_page, 40);
+            assert_eq(zones.Insert(5, 5, pieces), 0);
+            assert_eq(zones.count(), 2);
+        });
+
+        it("should clip range ends", function {
+            PagesZones zones;
+            PagesZone pieces[PagesZones::kMaxZones + 1];
+            zones.Insert(10, 20, pieces);
+            assert_eq(zones.Insert(15, 25, pieces), 1);
+            assert_eq(pieces[0].first_page, 20);
+            assert_eq(pieces[0].last_page, 25);
+            assert_eq(zones.Insert(5, 12, pieces), 1);
+            assert_eq(pieces[0].first_page, 5);
+            assert_eq(pieces[0].last_page, 10);
+            assert_eq(zones.Insert(12, 18, pieces), 0);
+        });
+
+        it("should split range around contained zones", function {
+            PagesZones zones;
+            PagesZone pieces[PagesZones::kMaxZones + 1];
+            zones.Insert(10, 20, pieces);
+            zones.Insert(30, 40, pieces);
+            assert_eq(zones.Insert(0, 50, pieces), 3);
+            assert_eq(pieces[0].first_page, 0);
+            assert_eq(pieces[0].last_page, 10);
+            assert_eq(pieces[1].first_page, 20);
+            assert_eq(pieces[1].last_page, 30);
+            assert_eq(pieces[2].first_page, 40);
+            assert_eq(pieces[2].last_page, 50);
+            assert_eq(zones.count(), 5);
+            assert_eq(zones.Insert(0, 50, pieces), 0);
+        });
+
+        it("should clip range spanning two zones", function {
+            PagesZones zones;
+            PagesZone pieces[PagesZones::kMaxZones + 1];
+            zones.Insert(10, 20, pieces);
+            zones.Insert(30, 40, pieces);
+            assert_eq(zones.Insert(15, 35, pieces), 1);
+            assert_eq(pieces[0].first_page, 20);
+            assert_eq(pieces[0].last_page, 30);
+        });
+    }
+
+    describe("PagesExtents") {
+        it("should pop pages from last extent", function {
+            PagesExtents extents;
+            assert_eq(extents.push(10, 12), true);
+            assert_eq(extents.push(20, 21), true);
+            assert_eq(extents.push(30, 30), true);
+            assert_eq(extents.pages_count(), 3);
+            assert_eq(extents.pop(), 20);
+            assert_eq(extents.pop(), 11);
+            assert_eq(extents.pop(), 10);
+            assert_eq(extents.pop(), 0);
+            assert_eq(extents.pages_count(), 0);
+        });
+
+        it("should report full extents table", function {
+            PagesExtents extents;
+            for (uint32_t i = 0; i < PagesExtents::kMaxExtents; ++i) {
+                assert_eq(extents.push(i * 10, i * 10 + 1), true);
+            }
+            assert_eq(extents.push(1000, 1001), false);
+
+            uint64_t first = 0;
+            uint64_t last = 0;
+            assert_eq(extents.pop_extent(&first, &last), true);
+            assert_eq(first, (PagesExtents::kMaxExtents - 1) * 10);
+            assert_eq(last, (PagesExtents::kMaxExtents - 1) * 10 + 1);
+        });
+    }
+}
+
+} // namespace test
@@ -0,0 +1,111 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cc/test.h>
+#include <kernel/transport.h>
+
+namespace test {
+
+using namespace rt;
+
+TEST(Transport) {
+
+    describe("ZigZag") {
+        it("should map small magnitudes to small codes", function {
+            assert_eq(ByteStream::ZigZagEncode(0), 0);
+            assert_eq(ByteStream::ZigZagEncode(-1), 1);
+            assert_eq(ByteStream::ZigZagEncode(1), 2);
+            assert_eq(ByteStream::ZigZagEncode(-2), 3);
+            assert_eq(ByteStream::ZigZagEncode(2147483647), 0xfffffffeu);
+            assert_eq(ByteStream::ZigZagEncode(-2147483647 - 1), 0xffffffffu);
+        });
+
+        it("should decode encoded values", function {
+            int32_t values[] { 0, 1, -1, 63, -64, 300, -300, 2147483647, -2147483647 - 1 };
+            for (int32_t v : values) {
+                assert_eq(ByteStream::ZigZagDecode(ByteStream::ZigZagEncode(v)), v);
+            }
+        });
+    }
+
+    describe("LEB128") {
+        it("should use 7 bits per byte", function {
+            uint32_t values[] { 0, 127, 128, 16383, 16384, 2097151, 2097152, 0xffffffffu };
+            size_t sizes[] { 1, 1, 2, 2, 3, 3, 4, 5 };
+            for (uint32_t i = 0; i < 8; ++i) {
+                ByteStream stream;
+                stream.AppendVarUint(values[i]);
+                assert_eq(stream.size(), sizes[i]);
+            }
+        });
+
+        it("should read back values in order", function {
+            uint32_t values[] { 0, 127, 128, 300, 16384, 0x7fffffffu, 0xffffffffu };
+            int32_t signed_values[] { 0, -1, 64, -65, -2147483647 - 1 };
+            ByteStream stream;
+            for (uint32_t v : values) {
+                stream.AppendVarUint(v);
+            }
+            for (int32_t v : signed_values) {
+                stream.AppendVarInt(v);
+            }
+            stream.AppendValue<uint8_t>(0xaa);
+
+            ByteStreamReader reader(stream);
+            for (uint32_t v : values) {
+                assert_eq(reader.ReadVarUint(), v);
+            }
+            for (int32_t v : signed_values) {
+                assert_eq(reader.ReadVarInt(), v);
+            }
+            assert_eq(reader.ReadValue<uint8_t>(), 0xaa);
+        });
+    }
+
+    describe("IdentityTable") {
+        it("should return index of object seen before", function {
+            int a, b, c;
+            IdentityTable<int*> table;
+            table.AddPlaceholder();
+            table.Add(10, &a);
+            table.Add(20, &b);
+
+            uint32_t index = 0;
+            assert_eq(table.Find(20, &b, &index), true);
+            assert_eq(index, 2);
+            assert_eq(table.Find(10, &a, &index), true);
+            assert_eq(index, 1);
+            assert_eq(table.Find(30, &c, &index), false);
+            assert_eq(table.count(), 3);
+        });
+
+        it("should tell apart objects with the same hash", function {
+            int a, b, c;
+            IdentityTable<int*> table;
+            table.Add(7, &a);
+            table.Add(7, &b);
+
+            uint32_t index = 0;
+            assert_eq(table.Find(7, &b, &index), true);
+            assert_eq(index, 1);
+            assert_eq(table.Find(7, &a, &index), true);
+            assert_eq(index, 0);
+            assert_eq(table.Find(7, &c, &index), false);
+        });
+    }
+}
+
+} // namespace test
@@ -12,10 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// Headers using std <functional> go before test.h,
+// it defines "function" macro
+#include <kernel/transport.h>
 #include <cc/test.h>
 
 // Include tests here
 #include <cc/test-utils.h>
+#include <cc/test-mem-manager.h>
+#include <cc/test-transport.h>
 
 namespace test {
 
@@ -29,6 +34,8 @@ void TestFramework::RunTests() {
     TestSpec spec;
 
     GET_SPEC(Utils);
+    GET_SPEC(MemManager);
+    GET_SPEC(Transport);
 
     spec.RunTests();
 }
@@ -0,0 +1,158 @@
+// Copyright 2014 Runtime.JS project authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host test for initrd/system/vfs.js path cache, run with
+// node test/js/test-vfs.js
+
+"use strict";
+
+var assert = require('assert');
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+
+function loadVfs() {
+    var source = fs.readFileSync(path.join(__dirname, '../../initrd/system/vfs.js'), 'utf8');
+    var context = vm.createContext({
+        define: function() {},
+        Map: Map,
+        Promise: Promise,
+    });
+
+    vm.runInContext(source, context);
+    return context.vfs;
+}
+
+var vfs = loadVfs();
+
+/**
+ * Single directory filesystem with mutable entries,
+ * counts backend lookups. vfs.init() mounts initrd
+ * so it's always present
+ */
+function createFsStub(names) {
+    var entries = new Map();
+    names.concat(['initrd']).forEach(function(name, index) {
+        entries.set(name, index + 2);
+    });
+
+    var stub = {
+        lookups: 0,
+        entries: entries,
+        lookup: function(inode, name, resolve) {
+            ++stub.lookups;
+            resolve(1 === inode ? (entries.get(name) || 0) : 0);
+        },
+        list: function(inode, resolve) {
+            resolve(1 === inode ? entries : new Map());
+        },
+        getRootInode: function() {
+            return 1;
+        },
+    };
+
+    return stub;
+}
+
+function lookup(root, str) {
+    return new Promise(function(resolve) {
+        vfs.pathLookup(root, vfs.parsePathString(str), resolve);
+    });
+}
+
+var tests = [];
+function it(name, fn) {
+    tests.push({name: name, fn: fn});
+}
+
+it('should cache found and missing paths', function() {
+    var stub = createFsStub(['a']);
+    return vfs.init(stub, createFsStub([])).then(function(root) {
+        var before = stub.lookups;
+        return lookup(root, '/a').then(function(node) {
+            assert.equal(node.name, 'a');
+            return lookup(root, '/missing');
+        }).then(function(node) {
+            assert.equal(node, null);
+            var after = stub.lookups;
+            return Promise.all([lookup(root, '/a'), lookup(root, '/missing')]).then(function(nodes) {
+                assert.equal(nodes[0].name, 'a');
+                assert.equal(nodes[1], null);
+                assert.equal(stub.lookups, after);
+                assert.ok(after > before);
+            });
+        });
+    });
+});
+
+it('should invalidate path cache on mount', function() {
+    var stub = createFsStub(['a', 'mnt']);
+    var mounted = createFsStub(['b']);
+    return vfs.init(stub, createFsStub([])).then(function(root) {
+        return lookup(root, '/mnt/b').then(function(node) {
+            assert.equal(node, null);
+            return lookup(root, '/mnt');
+        }).then(function(mnt) {
+            mnt.mount(new (root.constructor)(mounted, mounted.getRootInode(), 'mounted'));
+            return lookup(root, '/mnt/b');
+        }).then(function(node) {
+            assert.equal(node.name, 'b');
+        });
+    });
+});
+
+it('should invalidate path cache when node is invalidated', function() {
+    var stub = createFsStub(['a']);
+    return vfs.init(stub, createFsStub([])).then(function(root) {
+        return lookup(root, '/new').then(function(node) {
+            assert.equal(node, null);
+            stub.entries.set('new', 10);
+            return lookup(root, '/new');
+        }).then(function(node) {
+            assert.equal(node, null);
+            root.invalidate();
+            return lookup(root, '/new');
+        }).then(function(node) {
+            assert.equal(node.name, 'new');
+        });
+    });
+});
+
+it('should lookup multiple paths at once', function() {
+    var stub = createFsStub(['a', 'b']);
+    return vfs.init(stub, createFsStub([])).then(function(root) {
+        return vfs.pathLookupMany(root, ['/a', '/missing', 'b']);
+    }).then(function(nodes) {
+        assert.equal(nodes.length, 3);
+        assert.equal(nodes[0].name, 'a');
+        assert.equal(nodes[1], null);
+        assert.equal(nodes[2].name, 'b');
+    });
+});
+
+var failed = 0;
+tests.reduce(function(prev, test) {
+    return prev.then(function() {
+        return test.fn();
+    }).then(function() {
+        console.log('OK', test.name);
+    }, function(err) {
+        ++failed;
+        console.log('FAIL', test.name);
+        console.log(err.stack);
+    });
+}, Promise.resolve()).then(function() {
+    console.log(tests.length - failed, 'passed,', failed, 'failed');
+    process.exit(failed ? 1 : 0);
+});